@@ -16,10 +16,13 @@
 */
 
 /* System includes */
+#include <stdlib.h>
+#include <limits.h>
+#include <ctype.h>
+#include <math.h>
 #include <string.h> 
 
 /* EPICS includes */
-#include <drvIpac.h>
 #include <errlog.h>
 #include <ellLib.h>
 #include <devLib.h>
@@ -29,15 +32,126 @@
 #include <epicsMutex.h> 
 #include <epicsString.h> 
 #include <epicsExit.h>
-#include <epicsMessageQueue.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <epicsInterrupt.h>
+#include <epicsTime.h>
 #include <epicsExport.h>
 #include <iocsh.h>
 
 #include <asynPortDriver.h>
 
+#include "ipUnidigHardware.h"
+#include "ipUnidigShm.h"
+#include "ipUnidigEventLog.h"
+
 #define digitalInputString  "DIGITAL_INPUT"
 #define digitalOutputString "DIGITAL_OUTPUT"
+#define digitalInputFreshString "DIGITAL_INPUT_FRESH"
+#define inputCacheAgeString "INPUT_CACHE_AGE"
 #define DACOutputString     "DAC_OUTPUT"
+#define coalesceString      "COALESCE"
+#define maxCallbackRateString "MAX_CALLBACK_RATE"
+#define suppressedEdgesString "SUPPRESSED_EDGES"
+#define SOETimeStampString  "SOE_TIMESTAMP"
+#define SOEBitString        "SOE_BIT"
+#define SOEDirectionString  "SOE_DIRECTION"
+#define SOEInputString      "SOE_INPUT"
+#define SOENumEventsString  "SOE_NUM_EVENTS"
+#define SOEResetString      "SOE_RESET"
+#define risingCountString   "RISING_COUNT"
+#define fallingCountString  "FALLING_COUNT"
+#define risingLatchedString "RISING_LATCHED"
+#define fallingLatchedString "FALLING_LATCHED"
+#define countResetString    "COUNT_RESET"
+#define countLatchString    "COUNT_LATCH"
+#define countLatchMaskString "COUNT_LATCH_MASK"
+#define statsPeriodString   "STATS_PERIOD"
+#define frequencyString     "FREQUENCY"
+#define periodString        "PERIOD"
+#define dutyCycleString     "DUTY_CYCLE"
+#define gateTimeString      "GATE_TIME"
+#define outputAccessesSavedString "OUTPUT_ACCESSES_SAVED"
+#define messagesSentString  "MESSAGES_SENT"
+#define messagesFailedString "MESSAGES_FAILED"
+#define messagesCoalescedString "MESSAGES_COALESCED"
+#define serviceTimeString   "SERVICE_TIME"
+#define pollMaxPeriodString "POLL_MAX_PERIOD"
+#define pollCurrentPeriodString "POLL_CURRENT_PERIOD"
+#define pollMaskString      "POLL_MASK"
+#define pollPeriodString    "POLL_PERIOD"
+#define risingMaskString    "RISING_MASK"
+#define fallingMaskString   "FALLING_MASK"
+#define polarityString      "POLARITY"
+#define serviceMaxTimeString "SERVICE_MAX_TIME"
+#define outputBeginString   "OUTPUT_BEGIN"
+#define outputCommitString  "OUTPUT_COMMIT"
+#define outputAbortString   "OUTPUT_ABORT"
+#define outputStageString   "OUTPUT_STAGE"
+#define outputStagedMaskString "OUTPUT_STAGED_MASK"
+#define outputWindowString  "OUTPUT_WINDOW"
+#define seqTimesString      "SEQ_TIMES"
+#define seqValuesString     "SEQ_VALUES"
+#define seqMasksString      "SEQ_MASKS"
+#define seqNumStepsString   "SEQ_NUM_STEPS"
+#define seqArmString        "SEQ_ARM"
+#define seqTriggerString    "SEQ_TRIGGER"
+#define seqAbortString      "SEQ_ABORT"
+#define seqTriggerMaskString "SEQ_TRIGGER_MASK"
+#define seqStateString      "SEQ_STATE"
+#define seqStepsDoneString  "SEQ_STEPS_DONE"
+#define seqMaxLatencyString "SEQ_MAX_LATENCY"
+#define seqMeanLatencyString "SEQ_MEAN_LATENCY"
+#define seqLateStepsString  "SEQ_LATE_STEPS"
+#define interruptRateString "INTERRUPT_RATE"
+#define callbackRateString  "CALLBACK_RATE"
+#define busAccessRateString "BUS_ACCESS_RATE"
+#define queueDepthString    "QUEUE_DEPTH"
+#define queueHighWaterString "QUEUE_HIGH_WATER"
+#define latencyHistogramString "LATENCY_HISTOGRAM"
+#define latencyResetString  "LATENCY_RESET"
+#define lockHoldTimeString  "LOCK_HOLD_TIME"
+#define lockHoldMaxTimeString "LOCK_HOLD_MAX_TIME"
+#define bitAddressingString "BIT_ADDRESSING"
+#define debounceTimeString  "DEBOUNCE_TIME"
+#define glitchCountString   "GLITCH_COUNT"
+#define stormRateString     "STORM_RATE"
+#define stormQuietTimeString "STORM_QUIET_TIME"
+#define stormActiveString   "STORM_ACTIVE"
+#define stormTripsString    "STORM_TRIPS"
+#define stormMaskString     "STORM_MASK"
+#define logFreezeString     "LOG_FREEZE"
+#define logCountString      "LOG_COUNT"
+#define ruleEnableString    "RULE_ENABLE"
+#define ruleHitsString      "RULE_HITS"
+#define pulseWidthString    "PULSE_WIDTH"
+#define pulsePeriodString   "PULSE_PERIOD"
+#define pulseCountString    "PULSE_COUNT"
+#define pulseStartString    "PULSE_START"
+#define pulseRetriggerString "PULSE_RETRIGGER"
+#define pulseActiveString   "PULSE_ACTIVE"
+#define pulseActualWidthString "PULSE_ACTUAL_WIDTH"
+#define pulseJitterString   "PULSE_JITTER"
+#define pulseLateString     "PULSE_LATE"
+#define captureRateString   "CAPTURE_RATE"
+#define capturePreSamplesString "CAPTURE_PRE_SAMPLES"
+#define capturePostSamplesString "CAPTURE_POST_SAMPLES"
+#define captureEdgeMaskString "CAPTURE_EDGE_MASK"
+#define capturePatternMaskString "CAPTURE_PATTERN_MASK"
+#define capturePatternString "CAPTURE_PATTERN"
+#define captureArmString    "CAPTURE_ARM"
+#define captureTriggerString "CAPTURE_TRIGGER"
+#define captureStateString  "CAPTURE_STATE"
+#define captureDataString   "CAPTURE_DATA"
+#define capturePreCountString "CAPTURE_PRE_COUNT"
+#define captureActualRateString "CAPTURE_ACTUAL_RATE"
+#define captureLateString   "CAPTURE_LATE"
+
+/* Parameters of card group ports */
+#define groupInputsString   "GROUP_INPUTS"
+#define groupInputString    "GROUP_INPUT"
+#define groupReadString     "GROUP_READ"
+#define groupSampleTimeString "GROUP_SAMPLE_TIME"
 
 #define GREENSPRING_ID 0xF0
 #define SYSTRAN_ID     0x45
@@ -72,7 +186,65 @@
 
 #define SBS_IPOPTOIO8     0x02
 
-#define MAX_MESSAGES 1000
+/* Number of bits, and hence asyn addresses, for the per-bit parameters */
+#define MAX_BITS 32
+
+/* Number of slots in the interrupt ring buffer.  Must be a power of 2. */
+#define RING_SIZE 1024
+
+/* Ring depth at which intFunc() starts coalescing interrupts, so there is
+ * still room when coalescing is disabled while the slot is in use */
+#define RING_HIGH_WATER (RING_SIZE - RING_SIZE/8)
+
+/* Number of events in the sequence-of-events history.  Must be a power of 2. */
+#define SOE_SIZE 1024
+
+/* Interval over which intFunc() counts the interrupts of each bit for
+ * storm detection, in ns */
+#define STORM_WINDOW 100000000
+
+/* Shortest poll period that can be set with POLL_PERIOD, in seconds */
+#define MIN_POLL_PERIOD 0.001
+
+/* Maximum number of interlock rules, and of AND terms in one rule */
+#define MAX_RULES 32
+#define MAX_RULE_TERMS 8
+
+/* Maximum number of cards in a card group */
+#define MAX_GROUP_MEMBERS 8
+
+/* Maximum number of steps in the output sequencer table */
+#define SEQ_MAX_STEPS 1024
+
+/* Number of samples in the capture ring, pre plus post-trigger.  Must be a
+ * power of 2. */
+#define CAPTURE_SIZE 16384
+
+/* Highest capture rate in Hz.  A CAPTURE_RATE of 0 selects it. */
+#define CAPTURE_MAX_RATE 1000000.
+
+/* Longest time in ns that the capture, sequencer and pulse threads spin
+ * before they give up the CPU for a clock tick */
+#define SPIN_BURST 50000000
+
+/* Number of buckets in the interrupt to callback latency histogram.  Bucket 0
+ * counts latencies under 1 usec, bucket i those from 2^(i-1) to 2^i usec, and
+ * the last bucket everything longer. */
+#define LATENCY_BUCKETS 24
+
+/* Output sequencer states */
+typedef enum {
+  seqIdle,
+  seqArmed,
+  seqRunning
+} seqState;
+
+/* Input capture states */
+typedef enum {
+  captureIdle,
+  captureArmed,
+  captureTriggered
+} captureState;
 
 typedef struct {
   volatile epicsUInt16 *outputRegisterLow;
@@ -95,22 +267,375 @@ typedef struct {
   volatile epicsUInt16 *DACRegister;
 } ipUnidigRegisters;
 
+/* Register offsets of a module in 16-bit words, -1 if the register does not exist */
+typedef struct {
+  signed char outputLow, outputHigh;
+  signed char inputLow, inputHigh;
+  signed char outputEnableLow, outputEnableHigh;
+  signed char control0, control1;
+  signed char intVec;
+  signed char intEnableLow, intEnableHigh;
+  signed char intPolarityLow, intPolarityHigh;
+  signed char intClearLow, intClearHigh;
+  signed char intPendingLow, intPendingHigh;
+  signed char DAC;
+} ipUnidigLayout;
+
+/*                                                   out    in     enable  ctrl   vec  intEnable intPol    intClear  pending  DAC */
+static const ipUnidigLayout greenspringLayout   = {0, 1,  2, 3,  4, 5,   6,-1,  8,   9,0xa,  0xb,0xc,  0xd,0xe,  0xd,0xe, 0xe};
+/* The high voltage 16I8O modules don't allow access to the low output register */
+static const ipUnidigLayout greenspringHVLayout = {-1,1,  2, 3,  4, 5,   6,-1,  8,   9,0xa,  0xb,0xc,  0xd,0xe,  0xd,0xe, 0xe};
+static const ipUnidigLayout systranLayout       = {0, 1,  2,-1,  4, 5,   3, 4,  8,   9,0xa,  0xb,0xc,  0xd,0xe,  0xd,0xe, 0xe};
+static const ipUnidigLayout acromagLayout       = {2, 3,  0, 1,  4, 5,   6,-1,  8,   9,0xa,  0xb,0xc,  0xd,0xe,  0xd,0xe, 0xe};
+static const ipUnidigLayout sbsLayout           = {2,-1,  1,-1, -1,-1,   3,-1, -1,  -1,-1,   -1,-1,    -1,-1,    -1,-1,   -1};
+
+/* Module specific initialization, called after the register pointers are set */
+typedef void (*ipUnidigSetupFunc)(const ipUnidigRegisters *r);
+
+static void setupOpticalOutputs(const ipUnidigRegisters *r)
+{
+  /* Enable outputs */
+  *r->controlRegister0 |= 0x4;
+}
+
+static void setupHighVoltage(const ipUnidigRegisters *r)
+{
+  /* Set the comparator DAC for 2.5 volts.  Each bit is 15 mV. */
+  *r->DACRegister = 2500/15;
+}
+
+static void setupSystran(const ipUnidigRegisters *r)
+{
+  /* Enable outputs for ports 0-3 */
+  *r->controlRegister0  |= 0xf;
+  /* Set direction of ports 0-1 to be output */
+  *r->controlRegister1  |= 0x3;
+}
+
+static void setupSBS(const ipUnidigRegisters *r)
+{
+  *r->controlRegister0 = 0x00;   /* Start state machine reset */
+  *r->controlRegister0 = 0x01;   /* ....   */
+  *r->controlRegister0 = 0x00;   /* State machine in state 0 */
+  *r->controlRegister0 = 0x2B;   /* Select Port B DDR */
+  *r->controlRegister0 = 0xFF;   /* All Port B bits are inputs */
+  *r->controlRegister0 = 0x2A;   /* Select Port B DPPR */
+  *r->controlRegister0 = 0xFF;   /* All Port B bits inverted */
+  *r->controlRegister0 = 0x01;   /* Select MCCR */
+  *r->controlRegister0 = 0x84;   /* Enable ports A and B */
+}
+
+/* Everything the driver needs to know about a module.  Adding a module is
+ * one entry in modelTable. */
+typedef struct {
+  unsigned char manufacturer;
+  unsigned char model;
+  const char *name;
+  int inputBits;
+  int outputBits;
+  int supportsInterrupts;
+  int hasDAC;
+  int differentialOutputs;    /* Outputs must be enabled in the output enable registers */
+  const ipUnidigLayout *layout;
+  ipUnidigSetupFunc setup;
+} ipUnidigModel;
+
+static const ipUnidigModel modelTable[] = {
+/* manufacturer    model              name                    in  out ints DAC diff layout                setup */
+  {GREENSPRING_ID, UNIDIG_E,          "IP-Unidig-E",          24, 24, 0,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG,            "IP-Unidig",            24, 24, 0,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_D,          "IP-Unidig-D",          24, 24, 0,   0,  1,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_O_24IO,     "IP-Unidig-O-24IO",     24, 24, 0,   0,  0,   &greenspringLayout,   setupOpticalOutputs},
+  {GREENSPRING_ID, UNIDIG_HV_16I8O,   "IP-Unidig-HV-16I8O",   16,  8, 0,   1,  0,   &greenspringHVLayout, setupHighVoltage},
+  {GREENSPRING_ID, UNIDIG_E48,        "IP-Unidig-E48",        32, 32, 0,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_I_O_24I,    "IP-Unidig-I-O-24I",    24,  0, 1,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_I_E,        "IP-Unidig-I-E",        24, 24, 1,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_I,          "IP-Unidig-I",          24, 24, 1,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_I_D,        "IP-Unidig-I-D",        24, 24, 1,   0,  1,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_I_O_24IO,   "IP-Unidig-I-O-24IO",   24, 24, 1,   0,  0,   &greenspringLayout,   setupOpticalOutputs},
+  {GREENSPRING_ID, UNIDIG_I_HV_16I8O, "IP-Unidig-I-HV-16I8O", 16,  8, 1,   1,  0,   &greenspringHVLayout, setupHighVoltage},
+  {GREENSPRING_ID, UNIDIG_O_12I12O,   "IP-Unidig-O-12I12O",   12, 12, 0,   0,  0,   &greenspringLayout,   setupOpticalOutputs},
+  {GREENSPRING_ID, UNIDIG_I_O_12I12O, "IP-Unidig-I-O-12I12O", 12, 12, 1,   0,  0,   &greenspringLayout,   setupOpticalOutputs},
+  {GREENSPRING_ID, UNIDIG_O_24I,      "IP-Unidig-O-24I",      24,  0, 0,   0,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_HV_8I16O,   "IP-Unidig-HV-8I16O",    8, 16, 0,   1,  0,   &greenspringLayout,   NULL},
+  {GREENSPRING_ID, UNIDIG_I_HV_8I16O, "IP-Unidig-I-HV-8I16O",  8, 16, 1,   1,  0,   &greenspringLayout,   NULL},
+  {SYSTRAN_ID,     SYSTRAN_DIO316I,   "Systran DIO316I",      16, 32, 0,   0,  0,   &systranLayout,       setupSystran},
+  {ACROMAG_ID,     ACROMAG_IP408_32,  "Acromag IP408",        32, 32, 0,   0,  0,   &acromagLayout,       NULL},
+  {SBS_ID,         SBS_IPOPTOIO8,     "SBS IP-OPTOIO-8",       8,  8, 0,   0,  0,   &sbsLayout,           setupSBS},
+};
+
+/* Unknown modules are treated as a Greenspring IP-Unidig, as they always have been */
+static const ipUnidigModel unknownModel =
+  {0,              0,                 "unknown",              32, 32, 0,   0,  0,   &greenspringLayout,   NULL};
+
+static const ipUnidigModel *findModel(unsigned char manufacturer, unsigned char model)
+{
+  size_t i;
+
+  for (i=0; i<sizeof(modelTable)/sizeof(modelTable[0]); i++) {
+    if ((modelTable[i].manufacturer == manufacturer) && (modelTable[i].model == model))
+      return &modelTable[i];
+  }
+  return NULL;
+}
+
+/* Register access kernels, instantiated for each combination of half-word
+ * registers present, so the hot path has no per-call checks of the register
+ * pointers.  They are chosen by a switch on the registers the model has,
+ * not through function pointers, so the kernels are inlined at each call. */
+#define REGS_LOW  0x1
+#define REGS_HIGH 0x2
+
+static int registersPresent(int lowOffset, int highOffset)
+{
+  return ((lowOffset >= 0) ? REGS_LOW : 0) | ((highOffset >= 0) ? REGS_HIGH : 0);
+}
+
+/* Bus accesses of one read or write by the kernels below */
+static int registerAccesses(int regs)
+{
+  return ((regs & REGS_LOW) ? 1 : 0) + ((regs & REGS_HIGH) ? 1 : 0);
+}
+
+template <bool low, bool high>
+static inline epicsUInt32 readInputKernel(const ipUnidigRegisters *r)
+{
+  epicsUInt32 value = 0;
+  if (low)  value  = (epicsUInt32) *r->inputRegisterLow;
+  if (high) value |= (epicsUInt32) *r->inputRegisterHigh << 16;
+  return value;
+}
+
+template <bool low, bool high>
+static inline int writeOutputKernel(const ipUnidigRegisters *r, epicsUInt32 outputs, epicsUInt32 changed)
+{
+  /* Writes the half-words with changed bits, returns the number of bus writes */
+  int nWrites = 0;
+  if (low && (changed & 0xffff)) {
+    *r->outputRegisterLow = (epicsUInt16) outputs;
+    nWrites++;
+  }
+  if (high && (changed >> 16)) {
+    *r->outputRegisterHigh = (epicsUInt16) (outputs >> 16);
+    nWrites++;
+  }
+  return nWrites;
+}
+
+/* regs is the REGS_LOW and REGS_HIGH bits of the registers present */
+static inline epicsUInt32 readInputs(int regs, const ipUnidigRegisters *r)
+{
+  switch (regs) {
+    case REGS_LOW:             return readInputKernel<true,  false>(r);
+    case REGS_HIGH:            return readInputKernel<false, true>(r);
+    case REGS_LOW | REGS_HIGH: return readInputKernel<true,  true>(r);
+    default:                   return 0;
+  }
+}
+
+static inline int writeOutputRegisters(int regs, const ipUnidigRegisters *r,
+                                       epicsUInt32 outputs, epicsUInt32 changed)
+{
+  switch (regs) {
+    case REGS_LOW:             return writeOutputKernel<true,  false>(r, outputs, changed);
+    case REGS_HIGH:            return writeOutputKernel<false, true>(r, outputs, changed);
+    case REGS_LOW | REGS_HIGH: return writeOutputKernel<true,  true>(r, outputs, changed);
+    default:                   return 0;
+  }
+}
+
+/* An interlock rule compiled to masks.  The output is on if any term is
+ * true, and a term is true if (inputs & care[i]) == want[i]. */
+typedef struct {
+  int output;
+  int numTerms;
+  epicsUInt32 care[MAX_RULE_TERMS];
+  epicsUInt32 want[MAX_RULE_TERMS];
+  int enabled;
+  int lastResult;
+  epicsUInt32 hits;           /* Times the rule became true */
+  char *text;
+} ipUnidigRule;
+
+/* What a start does while a pulse output is already running */
+typedef enum {
+  pulseIgnore,                /* Nothing */
+  pulseExtend,                /* Restarts the width of the pulse that is high, and the count */
+  pulseQueue                  /* Starts the pulses again when they are done */
+} pulseRetrigger;
+
+/* A pulse output.  The settings are in ns.  The output goes high at
+ * riseDue, low width later, and high again period after riseDue. */
+typedef struct {
+  epicsUInt64 width;
+  epicsUInt64 period;         /* 0 for one pulse per start */
+  int count;                  /* Pulses per start, 0 until stopped if period is set */
+  int retrigger;
+  int active;
+  int high;
+  int remaining;              /* Pulses left, -1 until stopped */
+  int queued;                 /* Starts waiting for the pulses to finish */
+  epicsUInt64 riseDue;
+  epicsUInt64 nextEdge;
+  epicsUInt64 riseTime;       /* When the output was written high */
+  /* Achieved widths since the pulses were started from idle */
+  epicsUInt32 numPulses;
+  double lastWidth;           /* ns */
+  double sumError;            /* Of the width minus the setting, ns */
+  double sumError2;
+  epicsUInt32 lateEdges;      /* Written more than a clock tick late */
+} ipUnidigPulse;
+
+static int ruleToken(const char **pText, char *token, int size)
+{
+  /* Copies the next token of a rule to token.  Tokens are words, numbers
+   * and the single characters = & | ! ~.  Returns 0 at the end. */
+  const char *p = *pText;
+  int n = 0;
+
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == 0) return 0;
+  if (strchr("=&|!~", *p)) {
+    token[n++] = *p++;
+  } else {
+    while (*p && (isalnum((unsigned char)*p) || (*p == '_')) && (n < size-1)) token[n++] = *p++;
+    if (n == 0) token[n++] = *p++;
+  }
+  token[n] = 0;
+  *pText = p;
+  return 1;
+}
+
+static int ruleBit(const char *token, const char *prefix)
+{
+  /* Returns the bit number of a token like in3 or out7, -1 if it is not one */
+  size_t len = strlen(prefix);
+  char *end;
+  long bit;
+
+  if (epicsStrnCaseCmp(token, prefix, len) != 0) return -1;
+  bit = strtol(token + len, &end, 10);
+  if ((end == token + len) || *end || (bit < 0) || (bit >= MAX_BITS)) return -1;
+  return (int)bit;
+}
+
+static const char *parseRule(const char *text, ipUnidigRule *pRule)
+{
+  /* Compiles a rule like "out7 = in3 AND NOT in4 OR in5".  AND binds more
+   * tightly than OR.  & | ! and ~ can be used for AND, OR and NOT.  Returns
+   * NULL on success or a description of the error. */
+  char token[32];
+  int negate = 0, haveLiteral = 0, bit;
+  epicsUInt32 mask;
+
+  pRule->numTerms = 0;
+  if (!ruleToken(&text, token, sizeof(token)) || ((pRule->output = ruleBit(token, "out")) < 0))
+    return "rule must start with outN";
+  if (!ruleToken(&text, token, sizeof(token)) || strcmp(token, "="))
+    return "missing =";
+  pRule->care[0] = pRule->want[0] = 0;
+  while (ruleToken(&text, token, sizeof(token))) {
+    if (!strcmp(token, "!") || !strcmp(token, "~") || !epicsStrCaseCmp(token, "NOT")) {
+      negate = !negate;
+    } else if (!strcmp(token, "&") || !epicsStrCaseCmp(token, "AND")) {
+      if (!haveLiteral) return "AND without an input before it";
+      haveLiteral = 0;
+    } else if (!strcmp(token, "|") || !epicsStrCaseCmp(token, "OR")) {
+      if (!haveLiteral) return "OR without an input before it";
+      if (++pRule->numTerms == MAX_RULE_TERMS) return "too many OR terms";
+      pRule->care[pRule->numTerms] = pRule->want[pRule->numTerms] = 0;
+      haveLiteral = 0;
+    } else if ((bit = ruleBit(token, "in")) >= 0) {
+      if (haveLiteral) return "missing AND or OR";
+      mask = 1u << bit;
+      if ((pRule->care[pRule->numTerms] & mask) &&
+          (((pRule->want[pRule->numTerms] & mask) != 0) == negate))
+        return "a term needs an input both on and off";
+      pRule->care[pRule->numTerms] |= mask;
+      if (!negate) pRule->want[pRule->numTerms] |= mask;
+      negate = 0;
+      haveLiteral = 1;
+    } else {
+      return "unknown word";
+    }
+  }
+  if (!haveLiteral) return "rule must end with an input";
+  pRule->numTerms++;
+  return NULL;
+}
+
 typedef struct {
   epicsUInt32 bits;
   epicsUInt32 interruptMask;
+  epicsUInt32 risingMask;     /* Bits in interruptMask that had rising edges */
+  epicsUInt32 fallingMask;    /* Bits in interruptMask that had falling edges */
+  epicsTimeStamp timeStamp;   /* Time the interrupt was serviced */
+  epicsUInt32 usec;           /* epicsMonotonicGet() in microseconds, for intervals */
 } ipUnidigMessage;
 
+/* One entry in the sequence-of-events history */
+typedef struct {
+  epicsTimeStamp timeStamp;
+  epicsInt32 bit;
+  epicsInt32 direction;       /* 1=rising, 0=falling */
+  epicsUInt32 inputs;
+} ipUnidigEvent;
+
+/** Lock-free single-producer/single-consumer ring buffer of interrupt messages.
+  * intFunc() is the only producer and pollerThread() the only consumer, so head_
+  * and tail_ each have exactly one writer and no lock is needed.  push() is
+  * safe to call from interrupt context. */
+class ipUnidigRing
+{
+public:
+  ipUnidigRing() : head_(0), tail_(0) {}
+  bool push(const ipUnidigMessage *msg)
+  {
+    size_t head = head_;
+    if (head - epicsAtomicGetSizeT(&tail_) >= RING_SIZE) return false;
+    slots_[head & (RING_SIZE-1)] = *msg;
+    /* The slot must be visible before the consumer sees the new head */
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&head_, head+1);
+    return true;
+  }
+  bool pop(ipUnidigMessage *msg)
+  {
+    size_t tail = tail_;
+    if (epicsAtomicGetSizeT(&head_) == tail) return false;
+    epicsAtomicReadMemoryBarrier();
+    *msg = slots_[tail & (RING_SIZE-1)];
+    /* The slot must be copied before the producer is allowed to reuse it */
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&tail_, tail+1);
+    return true;
+  }
+  size_t depth() { return epicsAtomicGetSizeT(&head_) - epicsAtomicGetSizeT(&tail_); }
+
+private:
+  ipUnidigMessage slots_[RING_SIZE];
+  size_t head_;
+  size_t tail_;
+};
+
 
 static const char *driverName = "drvIpUnidig";
 
+class ipUnidigScheduler;
+
 
 /** This is the class definition for the IpUnidig class*/
 class IpUnidig : public asynPortDriver
 {
 public:
-  IpUnidig(const char *portName, int carrier, int slot, int msecPoll, int intVec, int risingMask, int fallingMask);
+  IpUnidig(const char *portName, ipUnidigHardware *hardware, int msecPoll, int intVec, int risingMask, int fallingMask);
   virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
   virtual asynStatus readInt32(asynUser *pasynUser, epicsInt32 *value);
+  virtual asynStatus writeFloat64(asynUser *pasynUser, epicsFloat64 value);
+  virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn);
+  virtual asynStatus readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn);
+  virtual asynStatus writeInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements);
+  virtual asynStatus writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements);
   virtual asynStatus getBounds(asynUser *pasynUser, epicsInt32 *low, epicsInt32 *high);
   virtual asynStatus readUInt32Digital(asynUser *pasynUser, epicsUInt32 *value, epicsUInt32 mask);
   virtual asynStatus writeUInt32Digital(asynUser *pasynUser, epicsUInt32 value, epicsUInt32 mask);
@@ -118,41 +643,463 @@ public:
   virtual asynStatus clearInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 mask);
   virtual asynStatus getInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 *mask, interruptReason reason);
   virtual void report(FILE *fp, int details);
+  virtual asynStatus lock();
+  virtual asynStatus unlock();
   // These should be private, but are called from C, so must be public
   void pollerThread();  
+  epicsUInt64 service();
+  int takeServiceRequest();
+  void sequencerThread();
+  void pulseThread();
+  void captureThread();
   void intFunc();
   void rebootCallback();
+  asynStatus setDebounce(epicsUInt32 mask, double seconds);
+  int addRule(const char *text);
+  int enableShm(const char *name, int ringSize);
+  int enableLog(const char *path, int numRecords);
+  int freezeLog(int postRecords);
+  /* Reads the inputs with no locking or side effects, for card groups */
+  epicsUInt32 sampleInputs() { return readInputs(inputRegs_, &regs_); }
 
 private:
   unsigned char manufacturer_;
   unsigned char model_;
-  epicsUInt16 *baseAddress_;
+  const ipUnidigModel *modelInfo_;
+  int inputRegs_;               /* REGS_LOW and REGS_HIGH of the input registers present */
+  int outputRegs_;              /* And of the output registers */
+  ipUnidigHardware *hardware_;
+  volatile epicsUInt16 *baseAddress_;
   int supportsInterrupts_;
   int rebooting_;
   epicsUInt32 risingMask_;
   epicsUInt32 fallingMask_;
   epicsUInt32 polarityMask_;
-  epicsUInt32 oldBits_;
+  epicsUInt32 oldBits_;         /* Last input sample */
+  epicsUInt32 publishedBits_;   /* Inputs as published, after debouncing */
   ipUnidigRegisters regs_;
   int forceCallback_;
   double pollTime_;
-  epicsMessageQueueId msgQId_;
+  /* Adaptive polling.  The poll period doubles from pollTime_ up to
+   * pollMaxPeriod_ while the polled bits don't change. */
+  double pollPeriod_;
+  double pollMaxPeriod_;
+  epicsUInt32 inputMask_;
+  epicsUInt32 outputMask_;
+  int pollReadsSkipped_;
+  ipUnidigRing ring_;
+  epicsEventId wakeEvent_;
+  /* Set when the card is serviced by the shared scheduler instead of its own
+   * poller thread */
+  ipUnidigScheduler *scheduler_;
+  int serviceRequested_;
+  epicsUInt64 nextPoll_;
+  epicsUInt64 nextStats_;
+  epicsUInt64 nextGate_;
+  epicsUInt64 serviceTimeSum_;
+  epicsUInt64 serviceTimeMax_;
+  int serviceCount_;
+  int coalesce_;
+  /* When the ring is nearly full intFunc() ORs pending masks into this extra
+   * slot, which service() claims after draining the ring.  While it is in use
+   * new messages keep going to it, so message order is preserved.  intFunc()
+   * writes the slot with coalesceSeq_ odd, and service() releases it by
+   * advancing coalesceSeq_ by 2 only if no write has started since it read. */
+  int coalesceSeq_;
+  int coalesceWrittenSeq_;    /* coalesceSeq_ after the last write by intFunc() */
+  int coalesceClaimedSeq_;    /* coalesceSeq_ after the last release by service() */
+  epicsUInt32 coalescedMask_;
+  epicsUInt32 coalescedRising_;
+  epicsUInt32 coalescedFalling_;
+  epicsUInt32 coalescedBits_;
+  epicsTimeStamp coalescedTime_;
+  epicsUInt32 coalescedUsec_;
   int messagesSent_;
   int messagesFailed_;
+  int messagesCoalesced_;
+  /* Per-bit callback rate limiting.  Times are from epicsMonotonicGet() in ns. */
+  epicsUInt64 minCallbackInterval_[MAX_BITS];
+  epicsUInt64 lastCallbackTime_[MAX_BITS];
+  int suppressedEdges_[MAX_BITS];
+  int limitedEdges_[MAX_BITS];     /* Edges of limited bits in this service() pass */
+  epicsUInt32 rateLimitedMask_;
+  epicsUInt32 deferredMask_;
+  /* Sequence-of-events history, only accessed with the port lock held.  The
+   * history and waveforms are allocated when the first event is recorded. */
+  ipUnidigEvent *events_;
+  epicsUInt32 numEvents_;      /* Total events since the last reset */
+  epicsFloat64 *SOETimeStamps_;
+  epicsInt32 *SOEBits_;
+  epicsInt32 *SOEDirections_;
+  epicsInt32 *SOEInputs_;
+  /* Per-bit edge counters.  Each counter is written either by intFunc(), for
+   * edges that generate interrupts, or by the poller, for those that don't.
+   * The counters are never cleared, resetting copies them to countBase. */
+  int interruptsEnabled_;
+  int haveSample_;
+  epicsUInt32 risingCounts_[MAX_BITS];
+  epicsUInt32 fallingCounts_[MAX_BITS];
+  epicsUInt32 risingBase_[MAX_BITS];
+  epicsUInt32 fallingBase_[MAX_BITS];
+  epicsUInt32 risingLatched_[MAX_BITS];
+  epicsUInt32 fallingLatched_[MAX_BITS];
+  epicsUInt32 countLatchMask_;
+  int latchPending_;
+  double statsPeriod_;
+  /* Frequency and duty cycle measurement.  Times are in microseconds from
+   * epicsMonotonicGet(), and wrap after 71 minutes, so only differences are used.
+   * lastRise and highTime are written by whichever of intFunc() and the poller
+   * counts the corresponding edge. */
+  epicsUInt32 lastRiseUsec_[MAX_BITS];
+  epicsUInt32 highTimeUsec_[MAX_BITS];
+  epicsUInt32 gateRisingCounts_[MAX_BITS];
+  epicsUInt32 gateHighTimeUsec_[MAX_BITS];
+  epicsUInt32 gateOpenUsec_[MAX_BITS];
+  epicsUInt32 gateStartUsec_;
+  double gateTime_;
+  /* Shadows of the output and output enable registers, so that outputs are
+   * written without reading them back, and only when they change */
+  epicsUInt32 outputShadow_;
+  epicsUInt32 outputEnableShadow_;
+  int differentialOutputs_;
+  int readModifyWriteCost_;
+  int outputAccessesSaved_;
+  /* Staged output writes.  They are written as one update when a transaction
+   * is committed, or when the output write window expires. */
+  int outputTransaction_;
+  epicsUInt32 stagedValue_;
+  epicsUInt32 stagedMask_;
+  double outputWindow_;
+  epicsUInt64 outputFlushTime_;
+  /* Interlock rules.  They are evaluated by intFunc() and the poller, and
+   * changed, with interrupts locked out.  Outside intFunc() they are always
+   * evaluated from the inputs read then, never from an older sample.  ruleOutputMask_ is the outputs of
+   * the enabled rules, which writeOutputs() leaves alone. */
+  ipUnidigRule rules_[MAX_RULES];
+  int numRules_;
+  epicsUInt32 ruleOutputMask_;
+  /* Pulse outputs.  pulseLock_ is taken by the pulse thread, which never
+   * takes the port lock, and with the port lock held. */
+  /* Shared memory publication, only written by the poller thread */
+  ipUnidigShm *shm_;
+  /* Event log, written by the poller thread and frozen with the port lock held */
+  ipUnidigEventLog *log_;
+  ipUnidigPulse pulses_[MAX_BITS];
+  epicsMutexId pulseLock_;
+  epicsEventId pulseEvent_;
+  epicsThreadId pulseThreadId_;
+  /* Input capture.  The ring and data are allocated when the capture is
+   * first armed.  The settings are copied to the capture thread's variables
+   * when it is armed, and captureState_ is changed atomically because
+   * intFunc() can trigger the capture. */
+  epicsUInt32 *captureRing_;
+  epicsInt32 *captureData_;
+  size_t captureNumSamples_;
+  int captureState_;
+  epicsEventId captureEvent_;
+  epicsThreadId captureThreadId_;
+  double captureRate_;
+  int capturePre_;
+  int capturePost_;
+  epicsUInt64 captureInterval_;
+  epicsUInt32 captureRunPre_;
+  epicsUInt32 captureRunPost_;
+  epicsUInt32 captureEdgeMask_;
+  epicsUInt32 capturePatternMask_;
+  epicsUInt32 capturePattern_;
+  /* Output sequencer.  The table is edited with the port lock held and copied
+   * to the play arrays when the sequencer is armed.  The arrays are allocated
+   * when a table is first written.  seqState_ is changed atomically, because
+   * intFunc() can trigger the sequencer. */
+  epicsFloat64 *seqTimes_;
+  epicsInt32 *seqValues_;
+  epicsInt32 *seqMasks_;
+  size_t seqNumTimes_;
+  size_t seqNumValues_;
+  size_t seqNumMasks_;
+  epicsUInt64 *seqPlayTimes_;
+  epicsUInt32 *seqPlayValues_;
+  epicsUInt32 *seqPlayMasks_;
+  int seqPlaySteps_;
+  int seqState_;
+  epicsUInt32 seqTriggerMask_;
+  epicsUInt64 seqTriggerTime_;
+  epicsEventId seqEvent_;
+  epicsThreadId seqThreadId_;
+  /* Performance instrumentation.  interruptCount_ and isrBusAccesses_ are
+   * only written by intFunc(), busAccesses_ is added to atomically because
+   * the sequencer writes outputs without the port lock.  The rest is only
+   * accessed with the port lock held. */
+  epicsUInt32 interruptCount_;
+  epicsUInt32 isrBusAccesses_;
+  int busAccesses_;
+  int inputReadCost_;           /* Bus accesses of one read of the input registers */
+  int isrReadCost_;
+  epicsUInt32 callbackCount_;
+  epicsUInt32 lastInterruptCount_;
+  epicsUInt32 lastBusAccesses_;
+  epicsUInt32 lastCallbackCount_;
+  epicsUInt64 lastStatsTime_;
+  double interruptRate_;
+  double callbackRate_;
+  double busAccessRate_;
+  int queueDepth_;
+  int queueHighWater_;
+  epicsUInt32 batchUsec_[RING_SIZE+1];
+  epicsInt32 latencyHistogram_[LATENCY_BUCKETS];
+  int lockDepth_;
+  epicsUInt64 lockTime_;
+  epicsUInt64 lockHoldSum_;
+  epicsUInt64 lockHoldMax_;
+  int lockHoldCount_;
+  /* Bit addressing, DIGITAL_INPUT is also published at the address of each bit */
+  int bitAddressing_;
+  /* Debouncing.  A debounced bit is published when it has differed from
+   * publishedBits_ for debounceUsec_ since its last edge at changeUsec_.
+   * Going back to the published state before then is a glitch. */
+  epicsUInt32 debounceMask_;
+  epicsUInt32 debounceUsec_[MAX_BITS];
+  epicsUInt32 changeUsec_[MAX_BITS];
+  epicsUInt32 glitchCounts_[MAX_BITS];
+  /* Interrupt storm protection.  intFunc() counts the interrupts of each bit
+   * in STORM_WINDOW, and when a bit has more than stormLimit_ it is added to
+   * stormMask_ and its interrupt is disabled, so it is polled.  The poller
+   * enables it again once it has not changed for stormQuietNs_.  stormMask_
+   * is changed with interrupts locked out.  stormChangeTime_ is written by
+   * intFunc() when it trips the bit and then by the poller. */
+  epicsUInt32 stormLimit_[MAX_BITS];
+  epicsUInt32 stormCount_[MAX_BITS];
+  epicsUInt64 stormWindowStart_[MAX_BITS];
+  epicsUInt64 stormChangeTime_[MAX_BITS];
+  epicsUInt32 stormTrips_[MAX_BITS];
+  epicsUInt32 stormMask_;
+  epicsUInt32 stormPublishedMask_;
+  epicsUInt64 stormQuietNs_;
+  /* Input snapshot for synchronous reads.  intFunc() and the threads each
+   * have their own copy, so each has a single writer.  The interrupt copy is
+   * written with isrCacheSeq_ odd, so readers can tell it was torn. */
+  double inputCacheAge_;
+  epicsUInt64 cacheAgeNs_;
+  epicsUInt32 cacheBits_;
+  epicsUInt64 cacheTime_;
+  int isrCacheSeq_;
+  epicsUInt32 isrCacheBits_;
+  epicsUInt64 isrCacheTime_;
+  int cacheHits_;
   // We need separate parameters for input and output because we don't want device
   // support to set the output records based on the input records, which it will do
   // if they are the same parameter.
   int digitalInputParam_;
   int digitalOutputParam_;
+  int digitalInputFreshParam_;
+  int inputCacheAgeParam_;
   int DACOutputParam_;
+  int coalesceParam_;
+  int maxCallbackRateParam_;
+  int suppressedEdgesParam_;
+  int SOETimeStampParam_;
+  int SOEBitParam_;
+  int SOEDirectionParam_;
+  int SOEInputParam_;
+  int SOENumEventsParam_;
+  int SOEResetParam_;
+  int risingCountParam_;
+  int fallingCountParam_;
+  int risingLatchedParam_;
+  int fallingLatchedParam_;
+  int countResetParam_;
+  int countLatchParam_;
+  int countLatchMaskParam_;
+  int statsPeriodParam_;
+  int frequencyParam_;
+  int periodParam_;
+  int dutyCycleParam_;
+  int gateTimeParam_;
+  int outputAccessesSavedParam_;
+  int messagesSentParam_;
+  int messagesFailedParam_;
+  int messagesCoalescedParam_;
+  int serviceTimeParam_;
+  int pollMaxPeriodParam_;
+  int pollCurrentPeriodParam_;
+  int pollMaskParam_;
+  int pollPeriodParam_;
+  int risingMaskParam_;
+  int fallingMaskParam_;
+  int polarityParam_;
+  int serviceMaxTimeParam_;
+  int outputBeginParam_;
+  int outputCommitParam_;
+  int outputAbortParam_;
+  int outputStageParam_;
+  int outputStagedMaskParam_;
+  int outputWindowParam_;
+  int seqTimesParam_;
+  int seqValuesParam_;
+  int seqMasksParam_;
+  int seqNumStepsParam_;
+  int seqArmParam_;
+  int seqTriggerParam_;
+  int seqAbortParam_;
+  int seqTriggerMaskParam_;
+  int seqStateParam_;
+  int seqStepsDoneParam_;
+  int seqMaxLatencyParam_;
+  int seqMeanLatencyParam_;
+  int seqLateStepsParam_;
+  int interruptRateParam_;
+  int callbackRateParam_;
+  int busAccessRateParam_;
+  int queueDepthParam_;
+  int queueHighWaterParam_;
+  int latencyHistogramParam_;
+  int latencyResetParam_;
+  int lockHoldTimeParam_;
+  int lockHoldMaxTimeParam_;
+  int bitAddressingParam_;
+  int debounceTimeParam_;
+  int glitchCountParam_;
+  int stormRateParam_;
+  int stormQuietTimeParam_;
+  int stormActiveParam_;
+  int stormTripsParam_;
+  int stormMaskParam_;
+  int logFreezeParam_;
+  int logCountParam_;
+  int ruleEnableParam_;
+  int ruleHitsParam_;
+  int pulseWidthParam_;
+  int pulsePeriodParam_;
+  int pulseCountParam_;
+  int pulseStartParam_;
+  int pulseRetriggerParam_;
+  int pulseActiveParam_;
+  int pulseActualWidthParam_;
+  int pulseJitterParam_;
+  int pulseLateParam_;
+  int captureRateParam_;
+  int capturePreSamplesParam_;
+  int capturePostSamplesParam_;
+  int captureEdgeMaskParam_;
+  int capturePatternMaskParam_;
+  int capturePatternParam_;
+  int captureArmParam_;
+  int captureTriggerParam_;
+  int captureStateParam_;
+  int captureDataParam_;
+  int capturePreCountParam_;
+  int captureActualRateParam_;
+  int captureLateParam_;
   
   void writeIntEnableRegs();
+  void setInterruptMasks(epicsUInt32 rising, epicsUInt32 falling, epicsUInt32 polarity);
+  void checkStorms(epicsUInt64 now, epicsUInt32 newBits, epicsUInt32 prevBits);
+  void requestService();
+  epicsUInt32 pollMask();
+  epicsUInt32 pollInputs(epicsUInt32 knownBits, epicsUInt32 mask);
+  void adaptPollPeriod(int changed);
+  epicsUInt32 rateLimit(epicsUInt32 interruptMask, epicsUInt64 now, epicsUInt64 *nextDeadline);
+  void countLimitedEdges(epicsUInt32 edges, epicsUInt32 doubleEdges);
+  void addEvent(const epicsTimeStamp *timeStamp, epicsUInt32 bits, int bit, int direction);
+  void addEvents(const epicsTimeStamp *timeStamp, epicsUInt32 bits, epicsUInt32 risingMask, epicsUInt32 fallingMask);
+  size_t copyEvents(epicsUInt32 first, epicsUInt32 last);
+  void publishEvents(epicsUInt32 first);
+  void processSample(const ipUnidigMessage *msg, epicsUInt32 prevBits);
+  void latchCounts();
+  void publishCounts(int latched);
+  void publishFrequencies(epicsUInt32 nowUsec, epicsUInt32 bits);
+  int writeOutputs(epicsUInt32 value, epicsUInt32 mask);
+  int updateOutputs(epicsUInt32 value, epicsUInt32 mask);
+  void evaluateRules(epicsUInt32 inputs);
+  void evaluateRulesNow();
+  void updateRuleOutputMask();
+  asynStatus startPulse(int bit);
+  void stopPulse(int bit);
+  epicsUInt64 pulseEdges(epicsUInt64 now, epicsUInt64 tick);
+  void publishPulse(int bit);
+  asynStatus armCapture();
+  void publishEvent(const ipUnidigMessage *msg);
+  void stageOutputs(epicsUInt32 value, epicsUInt32 mask);
+  void flushOutputs();
+  void allocateSequencer();
+  asynStatus armSequencer();
+  void triggerSequencer(epicsUInt64 now);
+  void coalesceMessage(const ipUnidigMessage *msg);
+  bool claimCoalesced(ipUnidigMessage *msg);
+  void publishPerformance(epicsUInt64 now);
+  void publishInputBits(epicsUInt32 bits, epicsUInt32 interruptMask);
+  void debounceSample(epicsUInt32 bits, epicsUInt32 prevBits, epicsUInt32 usec);
+  epicsUInt32 debounceInputs(epicsUInt32 bits, epicsUInt32 *interruptMask, epicsUInt64 now, epicsUInt64 *nextDeadline);
+  bool readInputCache(epicsUInt32 *bits, epicsUInt64 now);
 };
 
 #define MAX_IP_UNIDIG_CARDS 256
 static IpUnidig* driverTable[MAX_IP_UNIDIG_CARDS];
 static int numCards;
 
+/** Scheduler shared by all cards created after ipUnidigSchedulerConfig.  A
+  * small pool of worker threads replaces the poller thread of each card.
+  * Each card has a deadline, the earliest of its poll, statistics and
+  * deferred callback times, and a service request flag that intFunc() sets.
+  * A card is serviced by only one worker at a time, so its interrupt
+  * messages are still processed in order. */
+class ipUnidigScheduler
+{
+public:
+  ipUnidigScheduler(int numThreads, int priority);
+  void addCard(IpUnidig *pCard);
+  void wakeUp() { epicsEventSignal(wakeEvent_); }
+  void workerThread();
+  void report(FILE *fp);
+
+private:
+  epicsMutexId lock_;
+  epicsEventId wakeEvent_;
+  IpUnidig *cards_[MAX_IP_UNIDIG_CARDS];
+  epicsUInt64 deadlines_[MAX_IP_UNIDIG_CARDS];
+  int inService_[MAX_IP_UNIDIG_CARDS];
+  int numCards_;
+  int nextCard_;     /* Where the next scan starts, so no card is starved */
+  int numThreads_;
+};
+
+static ipUnidigScheduler *sharedScheduler;
+
+/** A port that samples the inputs of several IP-Unidig ports together.  The
+  * input registers of all the members are read back-to-back with interrupts
+  * locked out, and published with one time stamp as an Int32Array with one
+  * element per member, and as asynUInt32Digital callbacks at the address
+  * of each member. */
+class ipUnidigGroup : public asynPortDriver
+{
+public:
+  ipUnidigGroup(const char *portName, IpUnidig **members, int numMembers, int msecPoll);
+  virtual asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+  virtual asynStatus readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn);
+  virtual void report(FILE *fp, int details);
+  // This should be private, but is called from C, so must be public
+  void groupThread();
+
+private:
+  IpUnidig *members_[MAX_GROUP_MEMBERS];
+  int numMembers_;
+  double pollTime_;
+  epicsEventId wakeEvent_;
+  epicsInt32 inputs_[MAX_GROUP_MEMBERS];
+  epicsInt32 publishedInputs_[MAX_GROUP_MEMBERS];
+  int havePublished_;
+  epicsTimeStamp timeStamp_;
+  epicsUInt64 sampleNs_;
+  epicsUInt64 sampleMaxNs_;
+  int groupInputsParam_;
+  int groupInputParam_;
+  int groupReadParam_;
+  int groupSampleTimeParam_;
+
+  void sample();
+  void publish();
+};
+
 // These functions must have C linkage because they are called from other EPICS components
 extern "C" {
 static void rebootCallbackC(void * pPvt)
@@ -167,6 +1114,36 @@ static void pollerThreadC(void * pPvt)
   pIpUnidig->pollerThread();
 }
 
+static void sequencerThreadC(void * pPvt)
+{
+  IpUnidig *pIpUnidig = (IpUnidig *)pPvt;
+  pIpUnidig->sequencerThread();
+}
+
+static void pulseThreadC(void * pPvt)
+{
+  IpUnidig *pIpUnidig = (IpUnidig *)pPvt;
+  pIpUnidig->pulseThread();
+}
+
+static void captureThreadC(void * pPvt)
+{
+  IpUnidig *pIpUnidig = (IpUnidig *)pPvt;
+  pIpUnidig->captureThread();
+}
+
+static void groupThreadC(void * pPvt)
+{
+  ipUnidigGroup *pGroup = (ipUnidigGroup *)pPvt;
+  pGroup->groupThread();
+}
+
+static void schedulerThreadC(void * pPvt)
+{
+  ipUnidigScheduler *pScheduler = (ipUnidigScheduler *)pPvt;
+  pScheduler->workerThread();
+}
+
 static void intFuncC(int card)
 {
   IpUnidig *pIpUnidig = driverTable[card];
@@ -174,199 +1151,394 @@ static void intFuncC(int card)
 }
 }
 
-IpUnidig::IpUnidig(const char *portName, int carrier, int slot, int msecPoll, int intVec, int risingMask, int fallingMask)
-  :asynPortDriver(portName,1,
-                  asynInt32Mask | asynUInt32DigitalMask | asynDrvUserMask,
-                  asynUInt32DigitalMask,
-                  0,1,0,0),
+IpUnidig::IpUnidig(const char *portName, ipUnidigHardware *hardware, int msecPoll, int intVec, int risingMask, int fallingMask)
+  :asynPortDriver(portName,MAX_BITS,
+                  asynInt32Mask | asynFloat64Mask | asynUInt32DigitalMask |
+                  asynInt32ArrayMask | asynFloat64ArrayMask | asynDrvUserMask,
+                  asynInt32Mask | asynFloat64Mask | asynUInt32DigitalMask |
+                  asynInt32ArrayMask | asynFloat64ArrayMask,
+                  ASYN_MULTIDEVICE,1,0,0),
   risingMask_(risingMask),
   fallingMask_(fallingMask),
   polarityMask_(risingMask)
   
 {
   //static const char *functionName = "IpUnidig";
-  ipac_idProm_t *id;
-  epicsUInt16 *base;
+  volatile epicsUInt16 *base;
+  const ipUnidigLayout *l;
+  int i;
 
   /* Default of 100 msec for backwards compatibility with old version */
   if (msecPoll == 0) msecPoll = 100;
   pollTime_ = msecPoll / 1000.;
+  pollPeriod_ = pollTime_;
+  pollMaxPeriod_ = pollTime_;
+  pollReadsSkipped_ = 0;
   messagesSent_ = 0;
   messagesFailed_ = 0;
+  messagesCoalesced_ = 0;
+  coalesce_ = 1;
+  coalesceSeq_ = 0;
+  coalesceWrittenSeq_ = -1;
+  coalesceClaimedSeq_ = 0;
+  coalescedMask_ = 0;
+  coalescedRising_ = 0;
+  coalescedFalling_ = 0;
+  coalescedBits_ = 0;
+  events_ = NULL;
+  numEvents_ = 0;
+  SOETimeStamps_ = NULL;
+  SOEBits_ = NULL;
+  SOEDirections_ = NULL;
+  SOEInputs_ = NULL;
+  interruptsEnabled_ = 0;
+  haveSample_ = 0;
+  countLatchMask_ = 0;
+  latchPending_ = 0;
+  statsPeriod_ = 1.0;
+  gateTime_ = 1.0;
+  gateStartUsec_ = (epicsUInt32)(epicsMonotonicGet() / 1000);
+  outputAccessesSaved_ = 0;
+  outputTransaction_ = 0;
+  stagedValue_ = 0;
+  stagedMask_ = 0;
+  outputWindow_ = 0.;
+  outputFlushTime_ = 0;
   rebooting_ = 0;
   forceCallback_ = 0;
   oldBits_ = 0;
-  msgQId_ = epicsMessageQueueCreate(MAX_MESSAGES, sizeof(ipUnidigMessage));
-
-  if (ipmCheck(carrier, slot)) {
-    errlogPrintf("IpUnidig: bad carrier or slot\n");
+  publishedBits_ = 0;
+  debounceMask_ = 0;
+  inputCacheAge_ = 0.;
+  cacheAgeNs_ = 0;
+  cacheBits_ = 0;
+  cacheTime_ = 0;
+  isrCacheSeq_ = 0;
+  isrCacheBits_ = 0;
+  isrCacheTime_ = 0;
+  cacheHits_ = 0;
+  rateLimitedMask_ = 0;
+  deferredMask_ = 0;
+  for (i=0; i<MAX_BITS; i++) {
+    minCallbackInterval_[i] = 0;
+    lastCallbackTime_[i] = 0;
+    suppressedEdges_[i] = 0;
+    limitedEdges_[i] = 0;
+    risingCounts_[i] = fallingCounts_[i] = 0;
+    risingBase_[i] = fallingBase_[i] = 0;
+    risingLatched_[i] = fallingLatched_[i] = 0;
+    lastRiseUsec_[i] = highTimeUsec_[i] = 0;
+    gateRisingCounts_[i] = gateHighTimeUsec_[i] = gateOpenUsec_[i] = 0;
+    debounceUsec_[i] = changeUsec_[i] = glitchCounts_[i] = 0;
+    stormLimit_[i] = stormCount_[i] = stormTrips_[i] = 0;
+    stormWindowStart_[i] = stormChangeTime_[i] = 0;
   }
-  id = (ipac_idProm_t *) ipmBaseAddr(carrier, slot, ipac_addrID);
-  base = (epicsUInt16 *) ipmBaseAddr(carrier, slot, ipac_addrIO);
+  stormMask_ = 0;
+  stormPublishedMask_ = 0;
+  stormQuietNs_ = 1000000000;
+  wakeEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  scheduler_ = NULL;
+  serviceRequested_ = 0;
+  serviceTimeSum_ = 0;
+  serviceTimeMax_ = 0;
+  serviceCount_ = 0;
+  numRules_ = 0;
+  ruleOutputMask_ = 0;
+  memset(pulses_, 0, sizeof(pulses_));
+  pulseLock_ = epicsMutexMustCreate();
+  shm_ = NULL;
+  log_ = NULL;
+  pulseEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  pulseThreadId_ = NULL;
+  captureRing_ = NULL;
+  captureData_ = NULL;
+  captureNumSamples_ = 0;
+  captureState_ = captureIdle;
+  captureEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  captureThreadId_ = NULL;
+  captureRate_ = CAPTURE_MAX_RATE;
+  capturePre_ = 0;
+  capturePost_ = 1;
+  captureInterval_ = 0;
+  captureRunPre_ = 0;
+  captureRunPost_ = 1;
+  captureEdgeMask_ = 0;
+  capturePatternMask_ = 0;
+  capturePattern_ = 0;
+  seqEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  seqThreadId_ = NULL;
+  seqTimes_ = NULL;
+  seqValues_ = NULL;
+  seqMasks_ = NULL;
+  seqPlayTimes_ = NULL;
+  seqPlayValues_ = NULL;
+  seqPlayMasks_ = NULL;
+  seqNumTimes_ = 0;
+  seqNumValues_ = 0;
+  seqNumMasks_ = 0;
+  seqPlaySteps_ = 0;
+  seqState_ = seqIdle;
+  seqTriggerMask_ = 0;
+  seqTriggerTime_ = 0;
+  interruptCount_ = 0;
+  isrBusAccesses_ = 0;
+  busAccesses_ = 0;
+  callbackCount_ = 0;
+  lastInterruptCount_ = 0;
+  lastBusAccesses_ = 0;
+  lastCallbackCount_ = 0;
+  lastStatsTime_ = epicsMonotonicGet();
+  interruptRate_ = 0.;
+  callbackRate_ = 0.;
+  busAccessRate_ = 0.;
+  queueDepth_ = 0;
+  queueHighWater_ = 0;
+  for (i=0; i<LATENCY_BUCKETS; i++) latencyHistogram_[i] = 0;
+  lockDepth_ = 0;
+  lockTime_ = 0;
+  lockHoldSum_ = 0;
+  lockHoldMax_ = 0;
+  lockHoldCount_ = 0;
+  bitAddressing_ = 0;
+
+  hardware_ = hardware;
+  base = hardware_->baseAddress(&manufacturer_, &model_);
   baseAddress_ = base;
 
-  manufacturer_ = id->manufacturerId & 0xff;
-  model_ = id->modelId & 0xff;
-  switch (manufacturer_) {
-  case GREENSPRING_ID:
-    switch (model_) {
-      case UNIDIG_E:
-      case UNIDIG:
-      case UNIDIG_D:
-      case UNIDIG_O_24IO:
-      case UNIDIG_HV_16I8O:
-      case UNIDIG_E48:
-      case UNIDIG_I_O_24I:
-      case UNIDIG_I_E:
-      case UNIDIG_I:
-      case UNIDIG_I_D:
-      case UNIDIG_I_O_24IO:
-      case UNIDIG_I_HV_16I8O:
-      case UNIDIG_O_12I12O:
-      case UNIDIG_I_O_12I12O:
-      case UNIDIG_O_24I:
-      case UNIDIG_HV_8I16O:
-      case UNIDIG_I_HV_8I16O:
-        break;
-      default:
-        errlogPrintf("IpUnidig model 0x%x not supported\n",model_);
-        break;
-    }
-    break;
+  modelInfo_ = findModel(manufacturer_, model_);
+  if (!modelInfo_) {
+    errlogPrintf("IpUnidig manufacturer 0x%x model 0x%x not supported\n", manufacturer_, model_);
+    modelInfo_ = &unknownModel;
+  }
+
+  /* Set up the register pointers from the layout */
+  l = modelInfo_->layout;
+#define REGISTER(offset) (((offset) < 0) ? NULL : base + (offset))
+  regs_.outputRegisterLow        = REGISTER(l->outputLow);
+  regs_.outputRegisterHigh       = REGISTER(l->outputHigh);
+  regs_.inputRegisterLow         = REGISTER(l->inputLow);
+  regs_.inputRegisterHigh        = REGISTER(l->inputHigh);
+  regs_.outputEnableLow          = REGISTER(l->outputEnableLow);
+  regs_.outputEnableHigh         = REGISTER(l->outputEnableHigh);
+  regs_.controlRegister0         = REGISTER(l->control0);
+  regs_.controlRegister1         = REGISTER(l->control1);
+  regs_.intVecRegister           = REGISTER(l->intVec);
+  regs_.intEnableRegisterLow     = REGISTER(l->intEnableLow);
+  regs_.intEnableRegisterHigh    = REGISTER(l->intEnableHigh);
+  regs_.intPolarityRegisterLow   = REGISTER(l->intPolarityLow);
+  regs_.intPolarityRegisterHigh  = REGISTER(l->intPolarityHigh);
+  regs_.intClearRegisterLow      = REGISTER(l->intClearLow);
+  regs_.intClearRegisterHigh     = REGISTER(l->intClearHigh);
+  regs_.intPendingRegisterLow    = REGISTER(l->intPendingLow);
+  regs_.intPendingRegisterHigh   = REGISTER(l->intPendingHigh);
+  regs_.DACRegister              = REGISTER(l->DAC);
+#undef REGISTER
+  inputRegs_ = registersPresent(l->inputLow, l->inputHigh);
+  inputReadCost_ = registerAccesses(inputRegs_);
+  /* Bus accesses of one interrupt: pending reads, clear writes and input reads */
+  isrReadCost_ = registerAccesses(registersPresent(l->intPendingLow, l->intPendingHigh)) +
+                 registerAccesses(registersPresent(l->intClearLow, l->intClearHigh)) +
+                 inputReadCost_;
+  outputRegs_ = registersPresent(l->outputLow, l->outputHigh);
 
-  case SYSTRAN_ID:
-    if(model_ != SYSTRAN_DIO316I) {
-      errlogPrintf("IpUnidig model 0x%x not Systran DIO316I\n",model_);
-    }
-    break;
-       
-  case SBS_ID:
-    if(model_ != SBS_IPOPTOIO8) {
-      errlogPrintf("IpUnidig model 0x%x not SBS IP-OPTOIO-8\n",model_);
-    }
-    break;
-    
-  case ACROMAG_ID:
-    if(model_ != ACROMAG_IP408_32) {
-      errlogPrintf("ACROMAG model 0x%x not IP408 32 Channel Digital I/O\n",model_);
-    }
-    break;
-     
-  default: 
-    errlogPrintf("IpUnidig manufacturer 0x%x not supported\n", manufacturer_);
-    break;
-  }
-
-  /* Set up the register pointers.  Set the defaults for most modules */
-  /* Define registers in units of 16-bit words */
-  regs_.outputRegisterLow        = base;
-  regs_.outputRegisterHigh       = base + 0x1;
-  regs_.inputRegisterLow         = base + 0x2;
-  regs_.inputRegisterHigh        = base + 0x3;
-  regs_.outputEnableLow          = base + 0x4;
-  regs_.outputEnableHigh         = base + 0x5;
-  regs_.controlRegister0         = base + 0x6;
-  regs_.intVecRegister           = base + 0x8;
-  regs_.intEnableRegisterLow     = base + 0x9;
-  regs_.intEnableRegisterHigh    = base + 0xa;
-  regs_.intPolarityRegisterLow   = base + 0xb;
-  regs_.intPolarityRegisterHigh  = base + 0xc;
-  regs_.intClearRegisterLow      = base + 0xd;
-  regs_.intClearRegisterHigh     = base + 0xe;
-  regs_.intPendingRegisterLow    = base + 0xd;
-  regs_.intPendingRegisterHigh   = base + 0xe;
-  regs_.DACRegister              = base + 0xe;
-    
   /* Set things up for specific models which need to be treated differently */
-  switch (manufacturer_) {
-    case GREENSPRING_ID: 
-      switch (model_) {
-        case UNIDIG_O_24IO:
-        case UNIDIG_O_12I12O:
-        case UNIDIG_I_O_24IO:
-        case UNIDIG_I_O_12I12O:
-          /* Enable outputs */
-          *regs_.controlRegister0 |= 0x4;
-          break;
-        case UNIDIG_HV_16I8O:
-        case UNIDIG_I_HV_16I8O:
-          /*  These modules don't allow access to outputRegisterLow */
-          regs_.outputRegisterLow = NULL;
-          /* Set the comparator DAC for 2.5 volts.  Each bit is 15 mV. */
-          *regs_.DACRegister = 2500/15;
-          break;
-      }
-      break;
-    case SYSTRAN_ID:
-      switch (model_) {
-        case SYSTRAN_DIO316I:
-          /* Different register layout */
-          regs_.outputRegisterLow  = base;
-          regs_.outputRegisterHigh = base + 0x1;
-          regs_.inputRegisterLow   = base + 0x2;
-          regs_.inputRegisterHigh  = NULL;
-          regs_.controlRegister0   = base + 0x3;
-          regs_.controlRegister1   = base + 0x4;
-          /* Enable outputs for ports 0-3 */
-          *regs_.controlRegister0  |= 0xf;
-          /* Set direction of ports 0-1 to be output */
-          *regs_.controlRegister1  |= 0x3;
-          break;
-      }
-      break;
-    case ACROMAG_ID:
-      switch (model_) {
-        case ACROMAG_IP408_32:
-          /* Different register layout */
-          regs_.inputRegisterLow    = base;
-          regs_.inputRegisterHigh   = base + 0x1;
-          regs_.outputRegisterLow   = base + 0x2;
-          regs_.outputRegisterHigh  = base + 0x3;
-          regs_.intVecRegister      = base + 0x8;
-          break;
-      }
-      break;
-    case SBS_ID:
-      switch (model_) {
-        case SBS_IPOPTOIO8:
-          /* Different register layout */
-          memset(&regs_, 0, sizeof(regs_));
-          regs_.inputRegisterLow   = base + 1;
-          regs_.outputRegisterLow  = base + 2;
-          regs_.controlRegister0   = base + 3;
-          *regs_.controlRegister0 = 0x00;   /* Start state machine reset */
-          *regs_.controlRegister0 = 0x01;   /* ....   */
-          *regs_.controlRegister0 = 0x00;   /* State machine in state 0 */
-          *regs_.controlRegister0 = 0x2B;   /* Select Port B DDR */
-          *regs_.controlRegister0 = 0xFF;   /* All Port B bits are inputs */
-          *regs_.controlRegister0 = 0x2A;   /* Select Port B DPPR */
-          *regs_.controlRegister0 = 0xFF;   /* All Port B bits inverted */
-          *regs_.controlRegister0 = 0x01;   /* Select MCCR */
-          *regs_.controlRegister0 = 0x84;   /* Enable ports A and B */
-           break;
-      }
-      break;
+  if (modelInfo_->setup) modelInfo_->setup(&regs_);
+  differentialOutputs_ = modelInfo_->differentialOutputs;
+
+  /* Load the output shadows from the hardware.  The old read-modify-write
+   * output code set and then cleared bits in each output register, 4 bus
+   * accesses, and set bits in each enable register, 2 bus accesses. */
+  outputShadow_ = 0;
+  outputEnableShadow_ = 0;
+  readModifyWriteCost_ = 0;
+  if (regs_.outputRegisterLow) {
+    outputShadow_ = *regs_.outputRegisterLow;
+    readModifyWriteCost_ += 4;
   }
-  switch (model_) {
-    case UNIDIG_I_O_24I:
-    case UNIDIG_I_E:
-    case UNIDIG_I:
-    case UNIDIG_I_D:
-    case UNIDIG_I_O_24IO:
-    case UNIDIG_I_HV_16I8O:
-    case UNIDIG_I_O_12I12O:
-    case UNIDIG_I_HV_8I16O:
-      supportsInterrupts_ = 1;
-      break;
-    default:
-      supportsInterrupts_ = 0;
-      break;
+  if (regs_.outputRegisterHigh) {
+    outputShadow_ |= (epicsUInt32)*regs_.outputRegisterHigh << 16;
+    readModifyWriteCost_ += 4;
   }
+  if (differentialOutputs_) {
+    outputEnableShadow_ = *regs_.outputEnableLow | ((epicsUInt32)*regs_.outputEnableHigh << 16);
+    readModifyWriteCost_ += 4;
+  }
+
+  supportsInterrupts_ = modelInfo_->supportsInterrupts;
+  inputMask_ = (modelInfo_->inputBits >= 32) ? 0xffffffff : (1u << modelInfo_->inputBits) - 1;
+  /* The outputs of modules without a low output register start at bit 16 */
+  outputMask_ = (modelInfo_->outputBits >= 32) ? 0xffffffff : (1u << modelInfo_->outputBits) - 1;
+  if (!regs_.outputRegisterLow) outputMask_ <<= 16;
 
   /* Create the asynPortDriver parameter for the data */
   createParam(digitalInputString,  asynParamUInt32Digital, &digitalInputParam_); 
   createParam(digitalOutputString, asynParamUInt32Digital, &digitalOutputParam_); 
+  createParam(digitalInputFreshString, asynParamUInt32Digital, &digitalInputFreshParam_);
+  createParam(inputCacheAgeString, asynParamFloat64,       &inputCacheAgeParam_);
+  setDoubleParam(inputCacheAgeParam_, inputCacheAge_);
   createParam(DACOutputString,     asynParamInt32,         &DACOutputParam_); 
+  createParam(coalesceString,      asynParamInt32,         &coalesceParam_);
+  setIntegerParam(coalesceParam_, coalesce_);
+  /* These parameters are per-bit, the asyn address is the bit number */
+  createParam(maxCallbackRateString, asynParamFloat64,     &maxCallbackRateParam_);
+  createParam(suppressedEdgesString, asynParamInt32,       &suppressedEdgesParam_);
+  for (i=0; i<MAX_BITS; i++) {
+    setDoubleParam(i, maxCallbackRateParam_, 0.);
+    setIntegerParam(i, suppressedEdgesParam_, 0);
+    callParamCallbacks(i);
+  }
+  createParam(SOETimeStampString,  asynParamFloat64Array,  &SOETimeStampParam_);
+  createParam(SOEBitString,        asynParamInt32Array,    &SOEBitParam_);
+  createParam(SOEDirectionString,  asynParamInt32Array,    &SOEDirectionParam_);
+  createParam(SOEInputString,      asynParamInt32Array,    &SOEInputParam_);
+  createParam(SOENumEventsString,  asynParamInt32,         &SOENumEventsParam_);
+  createParam(SOEResetString,      asynParamInt32,         &SOEResetParam_);
+  setIntegerParam(SOENumEventsParam_, 0);
+  createParam(risingCountString,    asynParamInt32,        &risingCountParam_);
+  createParam(fallingCountString,   asynParamInt32,        &fallingCountParam_);
+  createParam(risingLatchedString,  asynParamInt32,        &risingLatchedParam_);
+  createParam(fallingLatchedString, asynParamInt32,        &fallingLatchedParam_);
+  createParam(countResetString,     asynParamInt32,        &countResetParam_);
+  createParam(countLatchString,     asynParamInt32,        &countLatchParam_);
+  createParam(countLatchMaskString, asynParamInt32,        &countLatchMaskParam_);
+  createParam(statsPeriodString,    asynParamFloat64,      &statsPeriodParam_);
+  createParam(glitchCountString,    asynParamInt32,        &glitchCountParam_);
+  createParam(stormRateString,      asynParamFloat64,      &stormRateParam_);
+  createParam(stormQuietTimeString, asynParamFloat64,      &stormQuietTimeParam_);
+  createParam(stormActiveString,    asynParamInt32,        &stormActiveParam_);
+  createParam(stormTripsString,     asynParamInt32,        &stormTripsParam_);
+  createParam(stormMaskString,      asynParamInt32,        &stormMaskParam_);
+  createParam(logFreezeString,      asynParamInt32,        &logFreezeParam_);
+  createParam(logCountString,       asynParamInt32,        &logCountParam_);
+  setIntegerParam(logFreezeParam_, 0);
+  setIntegerParam(logCountParam_, 0);
+  setDoubleParam(stormQuietTimeParam_, stormQuietNs_ / 1.e9);
+  setIntegerParam(stormMaskParam_, 0);
+  for (i=0; i<MAX_BITS; i++) {
+    setDoubleParam(i, stormRateParam_, 0.);
+    setIntegerParam(i, stormActiveParam_, 0);
+    setIntegerParam(i, stormTripsParam_, 0);
+  }
+  createParam(ruleEnableString,     asynParamInt32,        &ruleEnableParam_);
+  createParam(ruleHitsString,       asynParamInt32,        &ruleHitsParam_);
+  createParam(pulseWidthString,     asynParamFloat64,      &pulseWidthParam_);
+  createParam(pulsePeriodString,    asynParamFloat64,      &pulsePeriodParam_);
+  createParam(pulseCountString,     asynParamInt32,        &pulseCountParam_);
+  createParam(pulseStartString,     asynParamInt32,        &pulseStartParam_);
+  createParam(pulseRetriggerString, asynParamInt32,        &pulseRetriggerParam_);
+  createParam(pulseActiveString,    asynParamInt32,        &pulseActiveParam_);
+  createParam(pulseActualWidthString, asynParamFloat64,    &pulseActualWidthParam_);
+  createParam(pulseJitterString,    asynParamFloat64,      &pulseJitterParam_);
+  createParam(pulseLateString,      asynParamInt32,        &pulseLateParam_);
+  createParam(captureRateString,    asynParamFloat64,      &captureRateParam_);
+  createParam(capturePreSamplesString, asynParamInt32,     &capturePreSamplesParam_);
+  createParam(capturePostSamplesString, asynParamInt32,    &capturePostSamplesParam_);
+  createParam(captureEdgeMaskString, asynParamInt32,       &captureEdgeMaskParam_);
+  createParam(capturePatternMaskString, asynParamInt32,    &capturePatternMaskParam_);
+  createParam(capturePatternString, asynParamInt32,        &capturePatternParam_);
+  createParam(captureArmString,     asynParamInt32,        &captureArmParam_);
+  createParam(captureTriggerString, asynParamInt32,        &captureTriggerParam_);
+  createParam(captureStateString,   asynParamInt32,        &captureStateParam_);
+  createParam(captureDataString,    asynParamInt32Array,   &captureDataParam_);
+  createParam(capturePreCountString, asynParamInt32,       &capturePreCountParam_);
+  createParam(captureActualRateString, asynParamFloat64,   &captureActualRateParam_);
+  createParam(captureLateString,    asynParamInt32,        &captureLateParam_);
+  setDoubleParam(captureRateParam_, captureRate_);
+  setIntegerParam(capturePreSamplesParam_, 0);
+  setIntegerParam(capturePostSamplesParam_, 1);
+  setIntegerParam(captureStateParam_, captureIdle);
+  setIntegerParam(countLatchMaskParam_, 0);
+  setDoubleParam(statsPeriodParam_, statsPeriod_);
+  publishCounts(1);
+  createParam(frequencyString,      asynParamFloat64,      &frequencyParam_);
+  createParam(periodString,         asynParamFloat64,      &periodParam_);
+  createParam(dutyCycleString,      asynParamFloat64,      &dutyCycleParam_);
+  createParam(gateTimeString,       asynParamFloat64,      &gateTimeParam_);
+  setDoubleParam(gateTimeParam_, gateTime_);
+  createParam(outputAccessesSavedString, asynParamInt32,   &outputAccessesSavedParam_);
+  setIntegerParam(outputAccessesSavedParam_, 0);
+  createParam(messagesSentString,     asynParamInt32,      &messagesSentParam_);
+  createParam(messagesFailedString,   asynParamInt32,      &messagesFailedParam_);
+  createParam(messagesCoalescedString, asynParamInt32,     &messagesCoalescedParam_);
+  setIntegerParam(messagesSentParam_, 0);
+  setIntegerParam(messagesFailedParam_, 0);
+  setIntegerParam(messagesCoalescedParam_, 0);
+  createParam(serviceTimeString,      asynParamFloat64,    &serviceTimeParam_);
+  createParam(serviceMaxTimeString,   asynParamFloat64,    &serviceMaxTimeParam_);
+  setDoubleParam(serviceTimeParam_, 0.);
+  setDoubleParam(serviceMaxTimeParam_, 0.);
+  createParam(pollMaxPeriodString,    asynParamFloat64,    &pollMaxPeriodParam_);
+  createParam(pollCurrentPeriodString, asynParamFloat64,   &pollCurrentPeriodParam_);
+  createParam(pollMaskString,         asynParamInt32,      &pollMaskParam_);
+  setDoubleParam(pollMaxPeriodParam_, pollMaxPeriod_);
+  setDoubleParam(pollCurrentPeriodParam_, pollPeriod_);
+  setIntegerParam(pollMaskParam_, 0);
+  createParam(pollPeriodString,       asynParamFloat64,    &pollPeriodParam_);
+  createParam(risingMaskString,       asynParamInt32,      &risingMaskParam_);
+  createParam(fallingMaskString,      asynParamInt32,      &fallingMaskParam_);
+  createParam(polarityString,         asynParamInt32,      &polarityParam_);
+  setDoubleParam(pollPeriodParam_, pollTime_);
+  setIntegerParam(risingMaskParam_, risingMask_);
+  setIntegerParam(fallingMaskParam_, fallingMask_);
+  setIntegerParam(polarityParam_, polarityMask_);
+  createParam(outputBeginString,      asynParamInt32,      &outputBeginParam_);
+  createParam(outputCommitString,     asynParamInt32,      &outputCommitParam_);
+  createParam(outputAbortString,      asynParamInt32,      &outputAbortParam_);
+  createParam(outputStageString,      asynParamInt32Array, &outputStageParam_);
+  createParam(outputStagedMaskString, asynParamInt32,      &outputStagedMaskParam_);
+  createParam(outputWindowString,     asynParamFloat64,    &outputWindowParam_);
+  setIntegerParam(outputBeginParam_, 0);
+  setIntegerParam(outputStagedMaskParam_, 0);
+  setDoubleParam(outputWindowParam_, outputWindow_);
+  createParam(seqTimesString,         asynParamFloat64Array, &seqTimesParam_);
+  createParam(seqValuesString,        asynParamInt32Array, &seqValuesParam_);
+  createParam(seqMasksString,         asynParamInt32Array, &seqMasksParam_);
+  createParam(seqNumStepsString,      asynParamInt32,      &seqNumStepsParam_);
+  createParam(seqArmString,           asynParamInt32,      &seqArmParam_);
+  createParam(seqTriggerString,       asynParamInt32,      &seqTriggerParam_);
+  createParam(seqAbortString,         asynParamInt32,      &seqAbortParam_);
+  createParam(seqTriggerMaskString,   asynParamInt32,      &seqTriggerMaskParam_);
+  createParam(seqStateString,         asynParamInt32,      &seqStateParam_);
+  createParam(seqStepsDoneString,     asynParamInt32,      &seqStepsDoneParam_);
+  createParam(seqMaxLatencyString,    asynParamFloat64,    &seqMaxLatencyParam_);
+  createParam(seqMeanLatencyString,   asynParamFloat64,    &seqMeanLatencyParam_);
+  createParam(seqLateStepsString,     asynParamInt32,      &seqLateStepsParam_);
+  setIntegerParam(seqNumStepsParam_, 0);
+  setIntegerParam(seqTriggerMaskParam_, 0);
+  setIntegerParam(seqStateParam_, seqIdle);
+  setIntegerParam(seqStepsDoneParam_, 0);
+  setDoubleParam(seqMaxLatencyParam_, 0.);
+  setDoubleParam(seqMeanLatencyParam_, 0.);
+  setIntegerParam(seqLateStepsParam_, 0);
+  createParam(interruptRateString,    asynParamFloat64,    &interruptRateParam_);
+  createParam(callbackRateString,     asynParamFloat64,    &callbackRateParam_);
+  createParam(busAccessRateString,    asynParamFloat64,    &busAccessRateParam_);
+  createParam(queueDepthString,       asynParamInt32,      &queueDepthParam_);
+  createParam(queueHighWaterString,   asynParamInt32,      &queueHighWaterParam_);
+  createParam(latencyHistogramString, asynParamInt32Array, &latencyHistogramParam_);
+  createParam(latencyResetString,     asynParamInt32,      &latencyResetParam_);
+  createParam(lockHoldTimeString,     asynParamFloat64,    &lockHoldTimeParam_);
+  createParam(lockHoldMaxTimeString,  asynParamFloat64,    &lockHoldMaxTimeParam_);
+  setDoubleParam(interruptRateParam_, 0.);
+  setDoubleParam(callbackRateParam_, 0.);
+  setDoubleParam(busAccessRateParam_, 0.);
+  setIntegerParam(queueDepthParam_, 0);
+  setIntegerParam(queueHighWaterParam_, 0);
+  setDoubleParam(lockHoldTimeParam_, 0.);
+  setDoubleParam(lockHoldMaxTimeParam_, 0.);
+  createParam(bitAddressingString,    asynParamInt32,      &bitAddressingParam_);
+  setIntegerParam(bitAddressingParam_, 0);
+  createParam(debounceTimeString,     asynParamFloat64,    &debounceTimeParam_);
+  for (i=0; i<MAX_BITS; i++) {
+    setDoubleParam(i, debounceTimeParam_, 0.);
+    callParamCallbacks(i);
+  }
+  for (i=0; i<MAX_BITS; i++) {
+    setDoubleParam(i, frequencyParam_, 0.);
+    setDoubleParam(i, periodParam_, 0.);
+    setDoubleParam(i, dutyCycleParam_, 0.);
+    callParamCallbacks(i);
+  }
 
   // We use this to call readUInt32Digital, which needs the correct reason
   pasynUserSelf->reason = digitalInputParam_;
@@ -375,13 +1547,23 @@ IpUnidig::IpUnidig(const char *portName, int carrier, int slot, int msecPoll, in
   asynPortDriver::setUInt32DigitalInterrupt(digitalInputParam_, risingMask_, interruptOnZeroToOne);
   asynPortDriver::setUInt32DigitalInterrupt(digitalInputParam_, fallingMask_, interruptOnOneToZero);
    
-  /* Start the thread to poll and handle interrupt callbacks to 
-   * device support */
-  epicsThreadCreate("ipUnidig",
-                    epicsThreadPriorityHigh,
-                    epicsThreadGetStackSize(epicsThreadStackBig),
-                    (EPICSTHREADFUNC)pollerThreadC,
-                    this);
+  nextPoll_ = epicsMonotonicGet() + (epicsUInt64)(pollTime_ * 1.e9);
+  nextStats_ = epicsMonotonicGet() + (epicsUInt64)(statsPeriod_ * 1.e9);
+  nextGate_ = epicsMonotonicGet() + (epicsUInt64)(gateTime_ * 1.e9);
+  if (sharedScheduler) {
+    /* Polling and interrupt callbacks are done by the shared scheduler */
+    scheduler_ = sharedScheduler;
+    scheduler_->addCard(this);
+  } else {
+    /* Start the thread to poll and handle interrupt callbacks to 
+     * device support */
+    epicsThreadCreate("ipUnidig",
+                      epicsThreadPriorityHigh,
+                      epicsThreadGetStackSize(epicsThreadStackBig),
+                      (EPICSTHREADFUNC)pollerThreadC,
+                      this);
+  }
+
 
   /* If the interrupt vector is zero, don't bother with interrupts, 
    * since the user probably didn't pass this
@@ -391,18 +1573,17 @@ IpUnidig::IpUnidig(const char *portName, int carrier, int slot, int msecPoll, in
     /* Interrupt support */
     /* Write to the interrupt polarity and enable registers */
     *regs_.intVecRegister = intVec;
+    interruptsEnabled_ = 1;
     driverTable[numCards] = this;
     numCards++;
-    if (ipmIntConnect(carrier, slot, intVec, intFuncC, numCards-1)) {
+    if (hardware_->connectInterrupt(intVec, intFuncC, numCards-1)) {
       errlogPrintf("ipUnidig interrupt connect failure\n");
     }
     *regs_.intPolarityRegisterLow  = (epicsUInt16)polarityMask_;
     *regs_.intPolarityRegisterHigh = (epicsUInt16)(polarityMask_ >> 16);
     writeIntEnableRegs();
 
-    /* Enable IPAC module interrupts and set module status. */
-    ipmIrqCmd(carrier, slot, 0, ipac_irqEnable);
-    ipmIrqCmd(carrier, slot, 0, ipac_statActive);
+    hardware_->enableInterrupts();
   }
 
   epicsAtExit(rebootCallbackC, this);
@@ -413,30 +1594,66 @@ asynStatus IpUnidig::readUInt32Digital(asynUser *pasynUser, epicsUInt32 *value,
 {
   static const char *functionName = "readUInt32Digital";
   ipUnidigRegisters r = regs_;
+  epicsUInt64 now;
+  epicsUInt32 bits;
 
   if(rebooting_) epicsThreadSuspendSelf();
-  if (pasynUser->reason != digitalInputParam_) {
+  if ((pasynUser->reason != digitalInputParam_) && (pasynUser->reason != digitalInputFreshParam_)) {
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
               "%s:%s:, invalid reason=%d\n", 
               driverName, functionName, pasynUser->reason);
     return(asynError);
   }
-  *value = 0;
-  if (r.inputRegisterLow)  *value  = (epicsUInt32) *r.inputRegisterLow;
-  if (r.inputRegisterHigh) *value |= (epicsUInt32) (*r.inputRegisterHigh << 16);
-  *value &= mask;
+  now = epicsMonotonicGet();
+  if ((cacheAgeNs_ > 0) && (pasynUser->reason == digitalInputParam_) &&
+      readInputCache(&bits, now)) {
+    /* Served from the snapshot, no bus access */
+    cacheHits_++;
+    *value = bits & mask;
+    asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s:, cached *value=%x\n", 
+              driverName, functionName, *value);
+    return(asynSuccess);
+  }
+  bits = readInputs(inputRegs_, &r);
+  cacheBits_ = bits;
+  cacheTime_ = now;
+  *value = bits & mask;
+  epicsAtomicAddIntT(&busAccesses_, inputReadCost_);
   asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
             "%s:%s:, *value=%x\n", 
             driverName, functionName, *value);
   return(asynSuccess);
 }
 
+bool IpUnidig::readInputCache(epicsUInt32 *bits, epicsUInt64 now)
+{
+  /* Returns the newer of the two snapshots in *bits, and whether it is
+   * within the maximum age */
+  epicsUInt32 isrBits;
+  epicsUInt64 isrTime;
+  int seq;
+
+  *bits = cacheBits_;
+  do {
+    seq = epicsAtomicGetIntT(&isrCacheSeq_);
+    epicsAtomicReadMemoryBarrier();
+    isrBits = isrCacheBits_;
+    isrTime = isrCacheTime_;
+    epicsAtomicReadMemoryBarrier();
+  } while ((seq & 1) || (seq != epicsAtomicGetIntT(&isrCacheSeq_)));
+  if (isrTime > cacheTime_) {
+    *bits = isrBits;
+    return (now - isrTime) <= cacheAgeNs_;
+  }
+  return (cacheTime_ > 0) && ((now - cacheTime_) <= cacheAgeNs_);
+}
+
 asynStatus IpUnidig::writeUInt32Digital(asynUser *pasynUser, epicsUInt32 value, epicsUInt32 mask)
 {
   static const char *functionName = "writeUInt32Digital";
-  ipUnidigRegisters r = regs_;
+  int nWrites;
 
-  /* For the IP-Unidig differential output models, must enable all outputs */
   if(rebooting_) epicsThreadSuspendSelf();
   if (pasynUser->reason != digitalOutputParam_) {
     asynPrint(pasynUser, ASYN_TRACE_FLOW,
@@ -447,247 +1664,2420 @@ asynStatus IpUnidig::writeUInt32Digital(asynUser *pasynUser, epicsUInt32 value,
   /* Put value in parameter library */
   setUIntDigitalParam(pasynUser->reason, value, mask);
   
-  if ((manufacturer_ == GREENSPRING_ID)  &&
-      ((model_ == UNIDIG_D) || (model_ == UNIDIG_I_D))) {
-    *r.outputEnableLow  |= (epicsUInt16) mask;
-    *r.outputEnableHigh |= (epicsUInt16) (mask >> 16);
-  }
-  /* Set any bits that are set in the value and the mask */
-  if (r.outputRegisterLow)  *r.outputRegisterLow  |= (epicsUInt16) (value & mask);
-  if (r.outputRegisterHigh) *r.outputRegisterHigh |= (epicsUInt16) ((value & mask) >> 16);
-  /* Clear bits that are clear in the value and set in the mask */
-  if (r.outputRegisterLow)  *r.outputRegisterLow  &= (epicsUInt16) (value | ~mask);
-  if (r.outputRegisterHigh) *r.outputRegisterHigh &= (epicsUInt16) ((value | ~mask) >> 16);
+  if (outputTransaction_ || (outputWindow_ > 0.)) {
+    stageOutputs(value, mask);
+    asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s:%s:, staged value=%x, mask=%x\n", 
+              driverName, functionName, value, mask);
+    return(asynSuccess);
+  }
+  nWrites = writeOutputs(value, mask);
   asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
-            "%s:%s:, value=%x, mask=%x\n", 
-            driverName, functionName, value, mask);
+            "%s:%s:, value=%x, mask=%x, bus writes=%d, accesses saved=%d\n", 
+            driverName, functionName, value, mask, nWrites, outputAccessesSaved_);
   return(asynSuccess);
 }
 
-asynStatus IpUnidig::writeInt32(asynUser *pasynUser, epicsInt32 value)
+void IpUnidig::stageOutputs(epicsUInt32 value, epicsUInt32 mask)
 {
-  static const char *functionName = "writeInt32";
-  if (pasynUser->reason != DACOutputParam_) {
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "%s:%s:, invalid reason=%d\n", 
-              driverName, functionName, pasynUser->reason);
-    return(asynError);
+  if ((stagedMask_ == 0) && !outputTransaction_) {
+    /* First write in a new window, tell the poller when to flush it */
+    outputFlushTime_ = epicsMonotonicGet() + (epicsUInt64)(outputWindow_ * 1.e9);
+    requestService();
   }
-  /* Put value in parameter library */
-  setIntegerParam(pasynUser->reason, value);
+  stagedValue_ = (stagedValue_ & ~mask) | (value & mask);
+  stagedMask_ |= mask;
+  setIntegerParam(outputStagedMaskParam_, stagedMask_);
+}
 
-  ipUnidigRegisters r = regs_;
-  if ((manufacturer_ == GREENSPRING_ID)  &&
-      ((model_ == UNIDIG_HV_16I8O)   || (model_ == UNIDIG_HV_8I16O)  ||
-       (model_ == UNIDIG_I_HV_16I8O) || (model_ == UNIDIG_HV_8I16O))) 
-  {
-    *r.DACRegister  = value;
-    return(asynSuccess);
-  } 
-  else 
-  {
-    asynPrint(pasynUser, ASYN_TRACE_ERROR, 
-        "%s:%s,not allowed for this model",
-        driverName, functionName);
-    return(asynError);
-  }
+void IpUnidig::flushOutputs()
+{
+  static const char *functionName = "flushOutputs";
+  int nWrites;
+
+  if (stagedMask_ == 0) return;
+  nWrites = writeOutputs(stagedValue_, stagedMask_);
+  asynPrint(pasynUserSelf, ASYN_TRACEIO_DRIVER,
+            "%s:%s:, value=%x, mask=%x, bus writes=%d\n", 
+            driverName, functionName, stagedValue_, stagedMask_, nWrites);
+  stagedMask_ = 0;
+  setIntegerParam(outputStagedMaskParam_, 0);
 }
 
-asynStatus IpUnidig::readInt32(asynUser *pasynUser, epicsInt32 *value)
+int IpUnidig::writeOutputs(epicsUInt32 value, epicsUInt32 mask)
 {
-  static const char *functionName = "readInt32";
+  /* Called with the port lock held, and from the sequencer thread, which
+   * never takes the port lock while playing.  intFunc() also writes the
+   * outputs for the interlock rules, so the shadows are updated with
+   * interrupts locked out.  Outputs of enabled rules are not changed. */
+  int key, nWrites;
+
+  key = epicsInterruptLock();
+  nWrites = updateOutputs(value, mask & ~ruleOutputMask_);
+  epicsInterruptUnlock(key);
+  epicsAtomicAddIntT(&busAccesses_, nWrites);
+  return nWrites;
+}
+
+int IpUnidig::updateOutputs(epicsUInt32 value, epicsUInt32 mask)
+{
+  /* Updates the bits in mask from the shadow registers.  Each half-word is
+   * written at most once, with no read-back, and only if it changes, so there
+   * are no glitches between setting and clearing bits.  Returns the number
+   * of bus writes.  Must be called with interrupts locked out. */
   ipUnidigRegisters r = regs_;
+  epicsUInt32 outputs, changed, enables;
+  int nWrites = 0;
 
-  if (pasynUser->reason != DACOutputParam_) {
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "%s:%s:, invalid reason=%d\n", 
-              driverName, functionName, pasynUser->reason);
-    return(asynError);
+  outputs = (outputShadow_ & ~mask) | (value & mask);
+  changed = outputs ^ outputShadow_;
+
+  /* For the IP-Unidig differential output models, must enable all outputs */
+  if (differentialOutputs_) {
+    enables = outputEnableShadow_ | mask;
+    if ((enables ^ outputEnableShadow_) & 0xffff) {
+      *r.outputEnableLow = (epicsUInt16) enables;
+      nWrites++;
+    }
+    if ((enables ^ outputEnableShadow_) >> 16) {
+      *r.outputEnableHigh = (epicsUInt16) (enables >> 16);
+      nWrites++;
+    }
+    outputEnableShadow_ = enables;
   }
-  if ((manufacturer_ == GREENSPRING_ID)  &&
-      ((model_ == UNIDIG_HV_16I8O)   || (model_ == UNIDIG_HV_8I16O)  ||
-       (model_ == UNIDIG_I_HV_16I8O) || (model_ == UNIDIG_HV_8I16O))) 
-  {
-    *value = *r.DACRegister;
-    return(asynSuccess);
-  } 
-  else 
-  {
-    asynPrint(pasynUser, ASYN_TRACE_ERROR, 
-        "%s:%s: not allowed for this model",
-        driverName, functionName);
-    return(asynError);
+  nWrites += writeOutputRegisters(outputRegs_, &r, outputs, changed);
+  outputShadow_ = outputs;
+  /* The saving of one update is never negative, and the total stops at its
+   * maximum rather than wrapping */
+  if (nWrites < readModifyWriteCost_) {
+    if (outputAccessesSaved_ > INT_MAX - (readModifyWriteCost_ - nWrites))
+      outputAccessesSaved_ = INT_MAX;
+    else
+      outputAccessesSaved_ += readModifyWriteCost_ - nWrites;
   }
+  return nWrites;
 }
 
-asynStatus IpUnidig::getBounds(asynUser *pasynUser, epicsInt32 *low, epicsInt32 *high)
+void IpUnidig::evaluateRules(epicsUInt32 inputs)
 {
-  static const char *functionName = "getBounds";
-  if ((manufacturer_ == GREENSPRING_ID)  &&
-      ((model_ == UNIDIG_HV_16I8O)   || (model_ == UNIDIG_HV_8I16O)  ||
-       (model_ == UNIDIG_I_HV_16I8O) || (model_ == UNIDIG_HV_8I16O))) 
-  {
-    *low = 0;
-    *high = 4095;
-    return(asynSuccess);
-  } 
-  else 
-  {
-    asynPrint(pasynUser, ASYN_TRACE_ERROR,
-        "%s:%s:, not allowed for this model", 
-        driverName, functionName);
-    return(asynError);
+  /* Computes the enabled rules from the inputs and writes their outputs */
+  ipUnidigRule *pRule;
+  epicsUInt32 value = 0, mask = 0;
+  int key, i, j, result;
+
+  key = epicsInterruptLock();
+  for (i=0; i<numRules_; i++) {
+    pRule = &rules_[i];
+    if (!pRule->enabled) continue;
+    result = 0;
+    for (j=0; j<pRule->numTerms; j++) {
+      if ((inputs & pRule->care[j]) == pRule->want[j]) {
+        result = 1;
+        break;
+      }
+    }
+    if (result && !pRule->lastResult) pRule->hits++;
+    pRule->lastResult = result;
+    mask |= 1u << pRule->output;
+    if (result) value |= 1u << pRule->output;
   }
+  if (mask) isrBusAccesses_ += updateOutputs(value, mask);
+  epicsInterruptUnlock(key);
 }
- 
-asynStatus IpUnidig::setInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 mask, interruptReason reason)
+
+void IpUnidig::evaluateRulesNow()
 {
-  //static const char *functionName = "setInterruptUInt32Digital";
- 
-  /* Call the base class method to put mask in parameter library so report shows it */
-  asynPortDriver::setInterruptUInt32Digital(pasynUser, mask, reason);
-  
-  switch (reason) {
-    case interruptOnZeroToOne:
-      risingMask_ = mask;
-      break;
-    case interruptOnOneToZero:
-      fallingMask_ = mask;
+  /* Evaluates the rules from the inputs as they are now.  oldBits_ and the
+   * messages can be older than the inputs intFunc() last evaluated, and
+   * would turn the outputs back until the next interrupt. */
+  ipUnidigRegisters r = regs_;
+  int key;
+
+  key = epicsInterruptLock();
+  evaluateRules(readInputs(inputRegs_, &r));
+  epicsInterruptUnlock(key);
+  epicsAtomicAddIntT(&busAccesses_, inputReadCost_);
+}
+
+void IpUnidig::updateRuleOutputMask()
+{
+  /* Must be called with interrupts locked out */
+  int i;
+
+  ruleOutputMask_ = 0;
+  for (i=0; i<numRules_; i++) {
+    if (rules_[i].enabled) ruleOutputMask_ |= 1u << rules_[i].output;
+  }
+}
+
+int IpUnidig::addRule(const char *text)
+{
+  /* Adds a rule, or replaces the rule for the same output, and enables it */
+  ipUnidigRule rule;
+  const char *error;
+  int key, i;
+
+  error = parseRule(text, &rule);
+  if (!error && !(outputMask_ & (1u << rule.output))) error = "no such output on this module";
+  if (error) {
+    errlogPrintf("IpUnidig %s: rule \"%s\": %s\n", this->portName, text, error);
+    return -1;
+  }
+  rule.enabled = 1;
+  rule.lastResult = 0;
+  rule.hits = 0;
+  rule.text = epicsStrDup(text);
+  lock();
+  key = epicsInterruptLock();
+  for (i=0; i<numRules_; i++) {
+    if (rules_[i].output == rule.output) break;
+  }
+  if (i == MAX_RULES) {
+    epicsInterruptUnlock(key);
+    unlock();
+    errlogPrintf("IpUnidig %s: more than %d rules\n", this->portName, MAX_RULES);
+    free(rule.text);
+    return -1;
+  }
+  if (i < numRules_) free(rules_[i].text);
+  rules_[i] = rule;
+  if (i == numRules_) numRules_++;
+  updateRuleOutputMask();
+  epicsInterruptUnlock(key);
+  setIntegerParam(i, ruleEnableParam_, 1);
+  setIntegerParam(i, ruleHitsParam_, 0);
+  callParamCallbacks(i);
+  /* Drive the output from the inputs until the next change */
+  evaluateRulesNow();
+  unlock();
+  return i;
+}
+
+asynStatus IpUnidig::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+  static const char *functionName = "writeInt32";
+  int addr;
+  int i, key;
+
+  /* addr indexes the per-bit arrays */
+  if ((getAddress(pasynUser, &addr) != asynSuccess) || (addr < 0) || (addr >= MAX_BITS)) {
+    asynPrint(pasynUser, ASYN_TRACE_ERROR,
+              "%s:%s:, invalid address\n", 
+              driverName, functionName);
+    return(asynError);
+  }
+  if (pasynUser->reason == coalesceParam_) {
+    coalesce_ = (value != 0);
+    setIntegerParam(coalesceParam_, coalesce_);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == SOEResetParam_) {
+    numEvents_ = 0;
+    setIntegerParam(SOENumEventsParam_, 0);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == outputBeginParam_) {
+    outputTransaction_ = 1;
+    setIntegerParam(outputBeginParam_, 1);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if ((pasynUser->reason == outputCommitParam_) || (pasynUser->reason == outputAbortParam_)) {
+    if (pasynUser->reason == outputCommitParam_) {
+      flushOutputs();
+    } else {
+      stagedMask_ = 0;
+      setIntegerParam(outputStagedMaskParam_, 0);
+    }
+    outputTransaction_ = 0;
+    setIntegerParam(outputBeginParam_, 0);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == seqArmParam_) {
+    return armSequencer();
+  }
+  if (pasynUser->reason == seqTriggerParam_) {
+    if (epicsAtomicGetIntT(&seqState_) != seqArmed) {
+      asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                "%s:%s:, sequencer is not armed\n", 
+                driverName, functionName);
+      return(asynError);
+    }
+    triggerSequencer(epicsMonotonicGet());
+    setIntegerParam(seqStateParam_, epicsAtomicGetIntT(&seqState_));
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == seqAbortParam_) {
+    /* A running sequence stops before its next step, the outputs keep their
+     * current values */
+    epicsAtomicSetIntT(&seqState_, seqIdle);
+    epicsEventSignal(seqEvent_);
+    setIntegerParam(seqStateParam_, seqIdle);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == seqTriggerMaskParam_) {
+    seqTriggerMask_ = value;
+    setIntegerParam(seqTriggerMaskParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == countResetParam_) {
+    /* value is the mask of bits whose counters are reset */
+    for (i=0; i<MAX_BITS; i++) {
+      if (!(value & (1u << i))) continue;
+      risingBase_[i]  = risingLatched_[i]  = risingCounts_[i];
+      fallingBase_[i] = fallingLatched_[i] = fallingCounts_[i];
+    }
+    publishCounts(1);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == countLatchParam_) {
+    latchCounts();
+    publishCounts(1);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == countLatchMaskParam_) {
+    countLatchMask_ = value;
+    setIntegerParam(countLatchMaskParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == bitAddressingParam_) {
+    bitAddressing_ = (value != 0);
+    setIntegerParam(bitAddressingParam_, bitAddressing_);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == queueHighWaterParam_) {
+    /* Allows the high-water mark to be reset */
+    queueHighWater_ = value;
+    setIntegerParam(queueHighWaterParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == latencyResetParam_) {
+    for (i=0; i<LATENCY_BUCKETS; i++) latencyHistogram_[i] = 0;
+    doCallbacksInt32Array(latencyHistogram_, LATENCY_BUCKETS, latencyHistogramParam_, 0);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == risingMaskParam_) {
+    setInterruptMasks(value, fallingMask_, polarityMask_);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == fallingMaskParam_) {
+    setInterruptMasks(risingMask_, value, polarityMask_);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == polarityParam_) {
+    /* Only changes the bits that interrupt on both edges */
+    setInterruptMasks(risingMask_, fallingMask_, value);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == captureArmParam_) {
+    /* 1 arms the capture, 0 aborts it */
+    if (value) return armCapture();
+    epicsAtomicSetIntT(&captureState_, captureIdle);
+    epicsEventSignal(captureEvent_);
+    setIntegerParam(captureArmParam_, 0);
+    setIntegerParam(captureStateParam_, captureIdle);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == captureTriggerParam_) {
+    epicsAtomicCmpAndSwapIntT(&captureState_, captureArmed, captureTriggered);
+    return(asynSuccess);
+  }
+  if ((pasynUser->reason == capturePreSamplesParam_) || (pasynUser->reason == capturePostSamplesParam_)) {
+    /* The pre and post-trigger samples must fit in the ring together, and
+     * there is at least one post-trigger sample, the trigger itself */
+    if (pasynUser->reason == capturePreSamplesParam_) {
+      if (value < 0) value = 0;
+      if (value > CAPTURE_SIZE - capturePost_) value = CAPTURE_SIZE - capturePost_;
+      capturePre_ = value;
+    } else {
+      if (value < 1) value = 1;
+      if (value > CAPTURE_SIZE - capturePre_) value = CAPTURE_SIZE - capturePre_;
+      capturePost_ = value;
+    }
+    setIntegerParam(pasynUser->reason, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if ((pasynUser->reason == captureEdgeMaskParam_) ||
+      (pasynUser->reason == capturePatternMaskParam_) ||
+      (pasynUser->reason == capturePatternParam_)) {
+    if (pasynUser->reason == captureEdgeMaskParam_) captureEdgeMask_ = value;
+    else if (pasynUser->reason == capturePatternMaskParam_) capturePatternMask_ = value;
+    else capturePattern_ = value;
+    setIntegerParam(pasynUser->reason, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == pulseStartParam_) {
+    /* 1 starts or retriggers the pulses, 0 stops them */
+    if (value) {
+      if (startPulse(addr) != asynSuccess) return(asynError);
+    } else {
+      stopPulse(addr);
+    }
+    setIntegerParam(addr, pulseStartParam_, value != 0);
+    setIntegerParam(addr, pulseActiveParam_, pulses_[addr].active);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if ((pasynUser->reason == pulseCountParam_) || (pasynUser->reason == pulseRetriggerParam_)) {
+    if (value < 0) return(asynError);
+    if ((pasynUser->reason == pulseRetriggerParam_) && (value > pulseQueue)) return(asynError);
+    epicsMutexMustLock(pulseLock_);
+    if (pasynUser->reason == pulseCountParam_) pulses_[addr].count = value;
+    else pulses_[addr].retrigger = value;
+    epicsMutexUnlock(pulseLock_);
+    setIntegerParam(addr, pasynUser->reason, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == ruleEnableParam_) {
+    if (addr >= numRules_) return(asynError);
+    key = epicsInterruptLock();
+    rules_[addr].enabled = (value != 0);
+    rules_[addr].lastResult = 0;
+    updateRuleOutputMask();
+    epicsInterruptUnlock(key);
+    if (value) evaluateRulesNow();
+    setIntegerParam(addr, ruleEnableParam_, value != 0);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == ruleHitsParam_) {
+    /* Allows the count to be reset */
+    if (addr >= numRules_) return(asynError);
+    rules_[addr].hits = value;
+    setIntegerParam(addr, ruleHitsParam_, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == logFreezeParam_) {
+    /* 1 freezes the log now, 0 resumes it */
+    if (!log_) return(asynError);
+    if (value) return (freezeLog(0) == 0) ? asynSuccess : asynError;
+    ipUnidigEventLogResume(log_);
+    setIntegerParam(logFreezeParam_, 0);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == stormTripsParam_) {
+    /* Allows the count to be reset */
+    stormTrips_[addr] = value;
+    setIntegerParam(addr, stormTripsParam_, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == glitchCountParam_) {
+    /* Allows the count to be reset */
+    glitchCounts_[addr] = value;
+    setIntegerParam(addr, glitchCountParam_, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == suppressedEdgesParam_) {
+    /* Allows the count to be reset */
+    suppressedEdges_[addr] = value;
+    setIntegerParam(addr, suppressedEdgesParam_, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason != DACOutputParam_) {
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s:%s:, invalid reason=%d\n", 
+              driverName, functionName, pasynUser->reason);
+    return(asynError);
+  }
+  /* Put value in parameter library */
+  setIntegerParam(pasynUser->reason, value);
+
+  ipUnidigRegisters r = regs_;
+  if (modelInfo_->hasDAC)
+  {
+    *r.DACRegister  = value;
+    epicsAtomicAddIntT(&busAccesses_, 1);
+    return(asynSuccess);
+  } 
+  else 
+  {
+    asynPrint(pasynUser, ASYN_TRACE_ERROR, 
+        "%s:%s,not allowed for this model",
+        driverName, functionName);
+    return(asynError);
+  }
+}
+
+asynStatus IpUnidig::readInt32(asynUser *pasynUser, epicsInt32 *value)
+{
+  static const char *functionName = "readInt32";
+  ipUnidigRegisters r = regs_;
+
+  if (pasynUser->reason != DACOutputParam_) {
+    /* The other parameters are all kept in the parameter library */
+    return asynPortDriver::readInt32(pasynUser, value);
+  }
+  if (modelInfo_->hasDAC)
+  {
+    *value = *r.DACRegister;
+    epicsAtomicAddIntT(&busAccesses_, 1);
+    return(asynSuccess);
+  } 
+  else 
+  {
+    asynPrint(pasynUser, ASYN_TRACE_ERROR, 
+        "%s:%s: not allowed for this model",
+        driverName, functionName);
+    return(asynError);
+  }
+}
+
+asynStatus IpUnidig::writeFloat64(asynUser *pasynUser, epicsFloat64 value)
+{
+  static const char *functionName = "writeFloat64";
+  epicsUInt64 ns, width, period;
+  epicsUInt32 limit;
+  int addr, key;
+
+  /* addr indexes the per-bit arrays */
+  if ((getAddress(pasynUser, &addr) != asynSuccess) || (addr < 0) || (addr >= MAX_BITS)) {
+    asynPrint(pasynUser, ASYN_TRACE_ERROR,
+              "%s:%s:, invalid address\n", 
+              driverName, functionName);
+    return(asynError);
+  }
+  if (pasynUser->reason == maxCallbackRateParam_) {
+    /* A rate of 0 means no limit */
+    if (value < 0.) value = 0.;
+    minCallbackInterval_[addr] = (value > 0.) ? (epicsUInt64)(1.e9 / value) : 0;
+    limitedEdges_[addr] = 0;
+    if (value > 0.)
+      rateLimitedMask_ |= (1u << addr);
+    else
+      rateLimitedMask_ &= ~(1u << addr);
+    setDoubleParam(addr, maxCallbackRateParam_, value);
+    callParamCallbacks(addr);
+    /* Let the poller recompute its timeout */
+    requestService();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == inputCacheAgeParam_) {
+    /* 0 disables the cache */
+    if (value < 0.) value = 0.;
+    inputCacheAge_ = value;
+    cacheAgeNs_ = (epicsUInt64)(value * 1.e9);
+    setDoubleParam(inputCacheAgeParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == debounceTimeParam_) {
+    return setDebounce(1u << addr, value);
+  }
+  if (pasynUser->reason == stormRateParam_) {
+    /* Interrupts per second above which the bit is polled.  0 disables the
+     * storm detection for the bit. */
+    if (value < 0.) value = 0.;
+    limit = (value > 0.) ? (epicsUInt32)ceil(value * STORM_WINDOW / 1.e9) : 0;
+    if ((value > 0.) && (limit < 1)) limit = 1;
+    key = epicsInterruptLock();
+    stormLimit_[addr] = limit;
+    stormCount_[addr] = 0;
+    epicsInterruptUnlock(key);
+    setDoubleParam(addr, stormRateParam_, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == stormQuietTimeParam_) {
+    if (value < 0.) value = 0.;
+    stormQuietNs_ = (epicsUInt64)(value * 1.e9);
+    setDoubleParam(stormQuietTimeParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == captureRateParam_) {
+    /* Takes effect when the capture is next armed.  0 selects the highest
+     * rate. */
+    if ((value <= 0.) || (value > CAPTURE_MAX_RATE)) value = CAPTURE_MAX_RATE;
+    captureRate_ = value;
+    setDoubleParam(captureRateParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if ((pasynUser->reason == pulseWidthParam_) || (pasynUser->reason == pulsePeriodParam_)) {
+    /* Takes effect at the next edge of pulses that are running.  A non-zero
+     * period must be at least the width. */
+    if (value < 0.) value = 0.;
+    ns = (epicsUInt64)(value * 1.e9);
+    epicsMutexMustLock(pulseLock_);
+    width = (pasynUser->reason == pulseWidthParam_) ? ns : pulses_[addr].width;
+    period = (pasynUser->reason == pulsePeriodParam_) ? ns : pulses_[addr].period;
+    if (period && (period < width)) {
+      epicsMutexUnlock(pulseLock_);
+      asynPrint(pasynUser, ASYN_TRACE_ERROR,
+                "%s:%s:, output %d period is less than the width\n", 
+                driverName, functionName, addr);
+      return(asynError);
+    }
+    pulses_[addr].width = width;
+    pulses_[addr].period = period;
+    epicsMutexUnlock(pulseLock_);
+    setDoubleParam(addr, pasynUser->reason, value);
+    callParamCallbacks(addr);
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == pollPeriodParam_) {
+    /* The fastest poll period, which was msecPoll.  The adaptive period
+     * restarts from it. */
+    if (value < MIN_POLL_PERIOD) value = MIN_POLL_PERIOD;
+    pollTime_ = value;
+    if (pollMaxPeriod_ < value) {
+      pollMaxPeriod_ = value;
+      setDoubleParam(pollMaxPeriodParam_, value);
+    }
+    pollPeriod_ = value;
+    nextPoll_ = epicsMonotonicGet() + (epicsUInt64)(value * 1.e9);
+    setDoubleParam(pollPeriodParam_, value);
+    setDoubleParam(pollCurrentPeriodParam_, value);
+    callParamCallbacks();
+    requestService();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == pollMaxPeriodParam_) {
+    /* The period never backs off below the poll time given to initIpUnidig */
+    if (value < pollTime_) value = pollTime_;
+    pollMaxPeriod_ = value;
+    if (pollPeriod_ > value) pollPeriod_ = value;
+    setDoubleParam(pollMaxPeriodParam_, value);
+    callParamCallbacks();
+    requestService();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == outputWindowParam_) {
+    /* 0 disables the output write window */
+    if (value < 0.) value = 0.;
+    outputWindow_ = value;
+    if ((value == 0.) && !outputTransaction_) flushOutputs();
+    setDoubleParam(outputWindowParam_, value);
+    callParamCallbacks();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == gateTimeParam_) {
+    /* The microsecond timers limit the gate time */
+    if (value < 0.01) value = 0.01;
+    if (value > 1000.) value = 1000.;
+    gateTime_ = value;
+    /* The gate in progress ends within the new gate time.  The results are
+     * for the actual length of the gate, so a shorter one is still right. */
+    ns = epicsMonotonicGet() + (epicsUInt64)(value * 1.e9);
+    if (ns < nextGate_) nextGate_ = ns;
+    setDoubleParam(gateTimeParam_, value);
+    callParamCallbacks();
+    requestService();
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == statsPeriodParam_) {
+    if (value < 0.01) value = 0.01;
+    statsPeriod_ = value;
+    /* A shorter period takes effect now, not when the old one has expired */
+    ns = epicsMonotonicGet() + (epicsUInt64)(value * 1.e9);
+    if (ns < nextStats_) nextStats_ = ns;
+    setDoubleParam(statsPeriodParam_, value);
+    callParamCallbacks();
+    requestService();
+    return(asynSuccess);
+  }
+  asynPrint(pasynUser, ASYN_TRACE_FLOW,
+            "%s:%s:, invalid reason=%d\n", 
+            driverName, functionName, pasynUser->reason);
+  return(asynError);
+}
+
+asynStatus IpUnidig::readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn)
+{
+  static const char *functionName = "readInt32Array";
+  epicsInt32 *pSource;
+  epicsUInt32 first;
+  size_t n;
+
+  if (pasynUser->reason == captureDataParam_) {
+    /* The last completed capture */
+    n = (nElements < captureNumSamples_) ? nElements : captureNumSamples_;
+    if (n > 0) memcpy(value, captureData_, n * sizeof(epicsInt32));
+    *nIn = n;
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == latencyHistogramParam_) {
+    n = (nElements < LATENCY_BUCKETS) ? nElements : LATENCY_BUCKETS;
+    memcpy(value, latencyHistogram_, n * sizeof(epicsInt32));
+    *nIn = n;
+    return(asynSuccess);
+  }
+  if (pasynUser->reason == SOEBitParam_)
+    pSource = SOEBits_;
+  else if (pasynUser->reason == SOEDirectionParam_)
+    pSource = SOEDirections_;
+  else if (pasynUser->reason == SOEInputParam_)
+    pSource = SOEInputs_;
+  else {
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s:%s:, invalid reason=%d\n", 
+              driverName, functionName, pasynUser->reason);
+    return(asynError);
+  }
+  /* Synchronous reads return the whole history, oldest event first */
+  first = (numEvents_ > SOE_SIZE) ? numEvents_ - SOE_SIZE : 0;
+  n = copyEvents(first, numEvents_);
+  if (n > nElements) n = nElements;
+  if (n > 0) memcpy(value, pSource, n * sizeof(epicsInt32));
+  *nIn = n;
+  return(asynSuccess);
+}
+
+asynStatus IpUnidig::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn)
+{
+  static const char *functionName = "readFloat64Array";
+  epicsUInt32 first;
+  size_t n;
+
+  if (pasynUser->reason != SOETimeStampParam_) {
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s:%s:, invalid reason=%d\n", 
+              driverName, functionName, pasynUser->reason);
+    return(asynError);
+  }
+  first = (numEvents_ > SOE_SIZE) ? numEvents_ - SOE_SIZE : 0;
+  n = copyEvents(first, numEvents_);
+  if (n > nElements) n = nElements;
+  if (n > 0) memcpy(value, SOETimeStamps_, n * sizeof(epicsFloat64));
+  *nIn = n;
+  return(asynSuccess);
+}
+
+asynStatus IpUnidig::writeInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements)
+{
+  static const char *functionName = "writeInt32Array";
+  size_t i;
+
+  if ((pasynUser->reason == seqValuesParam_) || (pasynUser->reason == seqMasksParam_)) {
+    if (nElements > SEQ_MAX_STEPS) nElements = SEQ_MAX_STEPS;
+    allocateSequencer();
+    if (pasynUser->reason == seqValuesParam_) {
+      memcpy(seqValues_, value, nElements * sizeof(epicsInt32));
+      seqNumValues_ = nElements;
+    } else {
+      memcpy(seqMasks_, value, nElements * sizeof(epicsInt32));
+      seqNumMasks_ = nElements;
+    }
+    return(asynSuccess);
+  }
+  if (pasynUser->reason != outputStageParam_) {
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s:%s:, invalid reason=%d\n", 
+              driverName, functionName, pasynUser->reason);
+    return(asynError);
+  }
+  /* The array is (value, mask) pairs.  Outside a transaction they are all
+   * written as a single update. */
+  for (i=0; i+1<nElements; i+=2) {
+    stageOutputs((epicsUInt32)value[i], (epicsUInt32)value[i+1]);
+  }
+  if (!outputTransaction_ && (outputWindow_ == 0.)) flushOutputs();
+  callParamCallbacks();
+  return(asynSuccess);
+}
+
+asynStatus IpUnidig::writeFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements)
+{
+  static const char *functionName = "writeFloat64Array";
+
+  if (pasynUser->reason != seqTimesParam_) {
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s:%s:, invalid reason=%d\n", 
+              driverName, functionName, pasynUser->reason);
+    return(asynError);
+  }
+  if (nElements > SEQ_MAX_STEPS) nElements = SEQ_MAX_STEPS;
+  allocateSequencer();
+  memcpy(seqTimes_, value, nElements * sizeof(epicsFloat64));
+  seqNumTimes_ = nElements;
+  return(asynSuccess);
+}
+
+void IpUnidig::allocateSequencer()
+{
+  /* The tables are only allocated when the sequencer is first used.  They are
+   * never freed, because the sequencer thread can be playing them. */
+  if (seqTimes_) return;
+  seqTimes_ = (epicsFloat64 *)callocMustSucceed(SEQ_MAX_STEPS, sizeof(epicsFloat64), "IpUnidig::allocateSequencer");
+  seqValues_ = (epicsInt32 *)callocMustSucceed(SEQ_MAX_STEPS, sizeof(epicsInt32), "IpUnidig::allocateSequencer");
+  seqMasks_ = (epicsInt32 *)callocMustSucceed(SEQ_MAX_STEPS, sizeof(epicsInt32), "IpUnidig::allocateSequencer");
+  seqPlayTimes_ = (epicsUInt64 *)callocMustSucceed(SEQ_MAX_STEPS, sizeof(epicsUInt64), "IpUnidig::allocateSequencer");
+  seqPlayValues_ = (epicsUInt32 *)callocMustSucceed(SEQ_MAX_STEPS, sizeof(epicsUInt32), "IpUnidig::allocateSequencer");
+  seqPlayMasks_ = (epicsUInt32 *)callocMustSucceed(SEQ_MAX_STEPS, sizeof(epicsUInt32), "IpUnidig::allocateSequencer");
+}
+
+asynStatus IpUnidig::armSequencer()
+{
+  static const char *functionName = "armSequencer";
+  size_t i, n;
+
+  if (epicsAtomicGetIntT(&seqState_) == seqRunning) {
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s:, sequencer is running\n", 
+              driverName, functionName);
+    return(asynError);
+  }
+  /* The table is as long as the shortest of the three arrays */
+  n = seqNumTimes_;
+  if (seqNumValues_ < n) n = seqNumValues_;
+  if (seqNumMasks_ < n) n = seqNumMasks_;
+  for (i=0; i<n; i++) {
+    if ((seqTimes_[i] < 0.) || ((i > 0) && (seqTimes_[i] < seqTimes_[i-1]))) {
+      asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s:, step %d time %f is negative or out of order\n", 
+                driverName, functionName, (int)i, seqTimes_[i]);
+      return(asynError);
+    }
+    seqPlayTimes_[i] = (epicsUInt64)(seqTimes_[i] * 1.e9);
+    seqPlayValues_[i] = seqValues_[i];
+    seqPlayMasks_[i] = seqMasks_[i];
+  }
+  seqPlaySteps_ = (int)n;
+  /* The sequencer thread is only started when a table is first armed.  It
+   * runs above the poller so that it is not delayed by callbacks, but below
+   * epicsThreadPriorityMax so that its spinning cannot starve the interrupt
+   * threads. */
+  if (!seqThreadId_) {
+    seqThreadId_ = epicsThreadCreate("ipUnidigSeq",
+                                     epicsThreadPriorityHigh + 1,
+                                     epicsThreadGetStackSize(epicsThreadStackMedium),
+                                     (EPICSTHREADFUNC)sequencerThreadC,
+                                     this);
+    if (!seqThreadId_) {
+      asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s:, cannot create the sequencer thread\n", 
+                driverName, functionName);
+      return(asynError);
+    }
+  }
+  epicsAtomicSetIntT(&seqState_, seqArmed);
+  setIntegerParam(seqNumStepsParam_, (int)n);
+  setIntegerParam(seqStateParam_, seqArmed);
+  callParamCallbacks();
+  return(asynSuccess);
+}
+
+void IpUnidig::triggerSequencer(epicsUInt64 now)
+{
+  /* Called from intFunc() as well as writeInt32, so only the caller that
+   * moves the state from armed to running starts the sequence */
+  if (epicsAtomicCmpAndSwapIntT(&seqState_, seqArmed, seqRunning) != seqArmed) return;
+  seqTriggerTime_ = now;
+  epicsEventSignal(seqEvent_);
+}
+
+asynStatus IpUnidig::startPulse(int bit)
+{
+  /* Starts the pulses on an output, or applies the retrigger policy if they
+   * are already running.  Called with the port lock held. */
+  static const char *functionName = "startPulse";
+  ipUnidigPulse *pPulse = &pulses_[bit];
+  int perStart;
+
+  if (!(outputMask_ & (1u << bit))) {
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s:, bit %d is not an output\n", 
+              driverName, functionName, bit);
+    return(asynError);
+  }
+  /* The pulse thread is only started when an output is first pulsed.  Like
+   * the sequencer, it runs just above the poller. */
+  if (!pulseThreadId_) {
+    pulseThreadId_ = epicsThreadCreate("ipUnidigPulse",
+                                       epicsThreadPriorityHigh + 1,
+                                       epicsThreadGetStackSize(epicsThreadStackMedium),
+                                       (EPICSTHREADFUNC)pulseThreadC,
+                                       this);
+    if (!pulseThreadId_) {
+      asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s:, cannot create the pulse thread\n", 
+                driverName, functionName);
+      return(asynError);
+    }
+  }
+  epicsMutexMustLock(pulseLock_);
+  if (pPulse->width == 0) {
+    epicsMutexUnlock(pulseLock_);
+    return(asynError);
+  }
+  if (pPulse->period == 0) perStart = 1;
+  else perStart = (pPulse->count > 0) ? pPulse->count : -1;
+  if (!pPulse->active) {
+    pPulse->active = 1;
+    pPulse->high = 0;
+    pPulse->remaining = perStart;
+    pPulse->queued = 0;
+    pPulse->nextEdge = epicsMonotonicGet();
+    pPulse->numPulses = 0;
+    pPulse->sumError = 0.;
+    pPulse->sumError2 = 0.;
+    pPulse->lateEdges = 0;
+  } else if (pPulse->retrigger == pulseExtend) {
+    if (pPulse->high) {
+      pPulse->riseDue = epicsMonotonicGet();
+      pPulse->nextEdge = pPulse->riseDue + pPulse->width;
+    }
+    pPulse->remaining = perStart;
+  } else if (pPulse->retrigger == pulseQueue) {
+    pPulse->queued++;
+  }
+  epicsMutexUnlock(pulseLock_);
+  epicsEventSignal(pulseEvent_);
+  return(asynSuccess);
+}
+
+void IpUnidig::stopPulse(int bit)
+{
+  /* Stops the pulses on an output and leaves it low */
+  ipUnidigPulse *pPulse = &pulses_[bit];
+
+  epicsMutexMustLock(pulseLock_);
+  if (pPulse->active && pPulse->high) writeOutputs(0, 1u << bit);
+  pPulse->active = 0;
+  pPulse->high = 0;
+  pPulse->queued = 0;
+  epicsMutexUnlock(pulseLock_);
+  epicsEventSignal(pulseEvent_);
+}
+
+epicsUInt64 IpUnidig::pulseEdges(epicsUInt64 now, epicsUInt64 tick)
+{
+  /* Writes the edges that are due by now, all in one output write, and
+   * returns when the next edge is due, 0 if there is none.  Edges more than
+   * tick late are counted.  Must be called with pulseLock_ held. */
+  ipUnidigPulse *pPulse;
+  epicsUInt32 value = 0, mask = 0, rose = 0, fell = 0;
+  epicsUInt64 next = 0, written;
+  double error;
+  int i;
+
+  for (i=0; i<MAX_BITS; i++) {
+    pPulse = &pulses_[i];
+    if (!pPulse->active || (pPulse->nextEdge > now)) continue;
+    mask |= 1u << i;
+    if (now - pPulse->nextEdge > tick) pPulse->lateEdges++;
+    if (!pPulse->high) {
+      value |= 1u << i;
+      rose |= 1u << i;
+      pPulse->high = 1;
+      pPulse->riseDue = pPulse->nextEdge;
+      pPulse->nextEdge = pPulse->riseDue + pPulse->width;
+      continue;
+    }
+    fell |= 1u << i;
+    pPulse->high = 0;
+    if (pPulse->remaining > 0) pPulse->remaining--;
+    if (pPulse->remaining != 0) {
+      pPulse->nextEdge = pPulse->riseDue + pPulse->period;
+    } else if (pPulse->queued > 0) {
+      pPulse->queued--;
+      pPulse->remaining = (pPulse->period == 0) ? 1 : ((pPulse->count > 0) ? pPulse->count : -1);
+      pPulse->nextEdge = now;
+    } else {
+      pPulse->active = 0;
+    }
+  }
+  if (mask) {
+    writeOutputs(value, mask);
+    written = epicsMonotonicGet();
+    for (i=0; i<MAX_BITS; i++) {
+      pPulse = &pulses_[i];
+      if (rose & (1u << i)) pPulse->riseTime = written;
+      if (!(fell & (1u << i))) continue;
+      pPulse->lastWidth = (double)(written - pPulse->riseTime);
+      error = pPulse->lastWidth - pPulse->width;
+      pPulse->numPulses++;
+      pPulse->sumError += error;
+      pPulse->sumError2 += error * error;
+    }
+  }
+  for (i=0; i<MAX_BITS; i++) {
+    pPulse = &pulses_[i];
+    if (pPulse->active && ((next == 0) || (pPulse->nextEdge < next))) next = pPulse->nextEdge;
+  }
+  return next;
+}
+
+int IpUnidig::enableShm(const char *name, int ringSize)
+{
+  /* Starts publishing the inputs in a POSIX shared memory segment */
+  ipUnidigShm *pShm;
+
+  if (ringSize <= 0) ringSize = 1024;
+  pShm = ipUnidigShmCreate(name, this->portName, ringSize);
+  if (!pShm) return -1;
+  lock();
+  if (shm_) ipUnidigShmClose(shm_);
+  shm_ = pShm;
+  ipUnidigShmWriteState(shm_, oldBits_, outputShadow_, 0, 0);
+  unlock();
+  return 0;
+}
+
+int IpUnidig::enableLog(const char *path, int numRecords)
+{
+  /* Starts writing the input events to a memory mapped log file */
+  ipUnidigEventLog *pLog;
+
+  if (numRecords <= 0) numRecords = 100000;
+  pLog = ipUnidigEventLogOpen(path, this->portName, numRecords);
+  if (!pLog) return -1;
+  lock();
+  if (log_) ipUnidigEventLogClose(log_);
+  log_ = pLog;
+  setIntegerParam(logFreezeParam_, ipUnidigEventLogFrozen(log_));
+  setIntegerParam(logCountParam_, (epicsInt32)ipUnidigEventLogCount(log_));
+  callParamCallbacks();
+  unlock();
+  return 0;
+}
+
+int IpUnidig::freezeLog(int postRecords)
+{
+  /* Stops the log after postRecords more events.  Called with the port lock
+   * held, so the poller is not writing the log. */
+  if (!log_) return -1;
+  ipUnidigEventLogFreeze(log_, (postRecords > 0) ? postRecords : 0);
+  setIntegerParam(logFreezeParam_, 1);
+  callParamCallbacks();
+  return 0;
+}
+
+void IpUnidig::publishEvent(const ipUnidigMessage *msg)
+{
+  /* Writes an input event to the shared memory and the event log */
+  epicsUInt32 sec = msg->timeStamp.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH;
+
+  if (shm_)
+    ipUnidigShmWriteEvent(shm_, msg->bits, msg->interruptMask, msg->risingMask, outputShadow_,
+                          sec, msg->timeStamp.nsec);
+  if (log_)
+    ipUnidigEventLogWrite(log_, sec, msg->timeStamp.nsec, msg->bits, msg->interruptMask,
+                          msg->risingMask, outputShadow_);
+}
+
+asynStatus IpUnidig::armCapture()
+{
+  /* Copies the settings to the capture thread and starts it.  Called with the
+   * port lock held. */
+  static const char *functionName = "armCapture";
+
+  if (epicsAtomicGetIntT(&captureState_) != captureIdle) return(asynError);
+  if (!captureRing_) {
+    captureRing_ = (epicsUInt32 *)callocMustSucceed(CAPTURE_SIZE, sizeof(epicsUInt32), "IpUnidig::armCapture");
+    captureData_ = (epicsInt32 *)callocMustSucceed(CAPTURE_SIZE, sizeof(epicsInt32), "IpUnidig::armCapture");
+  }
+  /* The capture thread is only started when the capture is first armed.  It
+   * can spin for the whole capture, so it runs below the poller. */
+  if (!captureThreadId_) {
+    captureThreadId_ = epicsThreadCreate("ipUnidigCapture",
+                                         epicsThreadPriorityMedium,
+                                         epicsThreadGetStackSize(epicsThreadStackMedium),
+                                         (EPICSTHREADFUNC)captureThreadC,
+                                         this);
+    if (!captureThreadId_) {
+      asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+                "%s:%s:, cannot create the capture thread\n", 
+                driverName, functionName);
+      return(asynError);
+    }
+  }
+  captureInterval_ = (epicsUInt64)(1.e9 / captureRate_);
+  captureRunPre_ = capturePre_;
+  captureRunPost_ = capturePost_;
+  epicsAtomicSetIntT(&captureState_, captureArmed);
+  epicsEventSignal(captureEvent_);
+  setIntegerParam(captureStateParam_, captureArmed);
+  setIntegerParam(captureArmParam_, 1);
+  callParamCallbacks();
+  return(asynSuccess);
+}
+
+void IpUnidig::captureThread()
+{
+  /* Samples the inputs into the capture ring at captureInterval_ while the
+   * capture is armed, and for captureRunPost_ samples from the trigger.  The
+   * sampling loop does not take the port lock or allocate, so it does not
+   * delay record I/O.  Like the sequencer, it sleeps until one clock tick
+   * before each sample and then spins.  Above the clock rate it would spin
+   * for the whole capture, so after SPIN_BURST of spinning it gives up
+   * the CPU for a clock tick, and the gap counts as one late sample. */
+  epicsUInt64 start, due, now, interval, burstStart;
+  epicsUInt32 bits, prev, w, trig, preCount, i;
+  int state, triggered, late;
+  double quantum, timeout, elapsed;
+  static const char *functionName = "captureThread";
+
+  quantum = epicsThreadSleepQuantum();
+  while(1) {
+    epicsEventMustWait(captureEvent_);
+    if (epicsAtomicGetIntT(&captureState_) == captureIdle) continue;
+    interval = captureInterval_;
+    w = 0;
+    trig = 0;
+    triggered = 0;
+    late = 0;
+    prev = sampleInputs();
+    start = due = burstStart = epicsMonotonicGet();
+    while ((state = epicsAtomicGetIntT(&captureState_)) != captureIdle) {
+      now = epicsMonotonicGet();
+      if (now - burstStart >= SPIN_BURST) {
+        /* An abort signals the event */
+        epicsEventWaitWithTimeout(captureEvent_, quantum);
+        due = burstStart = epicsMonotonicGet();
+        late++;
+        continue;
+      }
+      if (now < due) {
+        timeout = (due - now) / 1.e9 - quantum;
+        if (timeout > 0.) {
+          epicsEventWaitWithTimeout(captureEvent_, timeout);
+          burstStart = epicsMonotonicGet();
+          continue;
+        }
+        while (epicsMonotonicGet() < due);
+      } else if (now - due > interval) {
+        late++;
+      }
+      bits = sampleInputs();
+      captureRing_[w & (CAPTURE_SIZE-1)] = bits;
+      if ((state == captureArmed) &&
+          (((bits ^ prev) & captureEdgeMask_) ||
+           (capturePatternMask_ && ((bits & capturePatternMask_) == capturePattern_)))) {
+        epicsAtomicCmpAndSwapIntT(&captureState_, captureArmed, captureTriggered);
+        state = epicsAtomicGetIntT(&captureState_);
+      }
+      if ((state == captureTriggered) && !triggered) {
+        triggered = 1;
+        trig = w;
+      }
+      prev = bits;
+      w++;
+      if (triggered && (w - trig >= captureRunPost_)) break;
+      due += interval;
+    }
+    if (!triggered) continue;
+    /* Copy the pre-trigger samples that were taken, and the post-trigger
+     * samples, oldest first.  readInt32Array() reads the data with the port
+     * lock held. */
+    elapsed = (epicsMonotonicGet() - start) / 1.e9;
+    preCount = (trig < captureRunPre_) ? trig : captureRunPre_;
+    lock();
+    captureNumSamples_ = preCount + captureRunPost_;
+    for (i=0; i<captureNumSamples_; i++) {
+      captureData_[i] = (epicsInt32)captureRing_[(trig - preCount + i) & (CAPTURE_SIZE-1)];
+    }
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW,
+              "%s:%s:, captured %d samples, %d before the trigger, %d late\n", 
+              driverName, functionName, (int)captureNumSamples_, (int)preCount, late);
+    epicsAtomicSetIntT(&captureState_, captureIdle);
+    setIntegerParam(captureStateParam_, captureIdle);
+    setIntegerParam(captureArmParam_, 0);
+    setIntegerParam(capturePreCountParam_, preCount);
+    setIntegerParam(captureLateParam_, late);
+    setDoubleParam(captureActualRateParam_, (elapsed > 0.) ? w / elapsed : 0.);
+    doCallbacksInt32Array(captureData_, captureNumSamples_, captureDataParam_, 0);
+    callParamCallbacks();
+    unlock();
+  }
+}
+
+void IpUnidig::pulseThread()
+{
+  /* Drives the pulse outputs.  Like the sequencer, it sleeps until one
+   * clock tick before the next edge and then spins, and after SPIN_BURST of
+   * spinning it gives up the CPU for a clock tick, which makes the edges
+   * that fall in it late.  A start or stop wakes it to recompute the next
+   * edge. */
+  epicsUInt64 due, now, burstStart, tick;
+  double quantum, timeout;
+
+  quantum = epicsThreadSleepQuantum();
+  tick = (epicsUInt64)(quantum * 1.e9);
+  burstStart = epicsMonotonicGet();
+  while(1) {
+    epicsMutexMustLock(pulseLock_);
+    due = pulseEdges(epicsMonotonicGet(), tick);
+    epicsMutexUnlock(pulseLock_);
+    if (due == 0) {
+      epicsEventMustWait(pulseEvent_);
+      burstStart = epicsMonotonicGet();
+      continue;
+    }
+    now = epicsMonotonicGet();
+    if (now >= due) continue;
+    timeout = (due - now) / 1.e9 - quantum;
+    if (timeout > 0.) {
+      epicsEventWaitWithTimeout(pulseEvent_, timeout);
+      burstStart = epicsMonotonicGet();
+      continue;
+    }
+    if (now - burstStart >= SPIN_BURST) {
+      epicsEventWaitWithTimeout(pulseEvent_, quantum);
+      burstStart = epicsMonotonicGet();
+      continue;
+    }
+    while (epicsMonotonicGet() < due);
+  }
+}
+
+void IpUnidig::sequencerThread()
+{
+  /* Plays the armed table against the output registers.  Each step sleeps
+   * until one clock tick before it is due and then spins, so the step jitter
+   * is set by the CPU and not by the system clock rate.  Steps closer than a
+   * clock tick would spin for the whole table, so after SPIN_BURST of
+   * spinning it gives up the CPU for a clock tick.  Steps written more than
+   * a clock tick late are counted. */
+  epicsUInt64 start, due, now, burstStart, tick;
+  epicsUInt64 maxLate, sumLate;
+  double quantum, timeout;
+  int i, late;
+  static const char *functionName = "sequencerThread";
+
+  quantum = epicsThreadSleepQuantum();
+  tick = (epicsUInt64)(quantum * 1.e9);
+  while(1) {
+    epicsEventMustWait(seqEvent_);
+    if (epicsAtomicGetIntT(&seqState_) != seqRunning) continue;
+    start = seqTriggerTime_;
+    maxLate = 0;
+    sumLate = 0;
+    late = 0;
+    burstStart = epicsMonotonicGet();
+    for (i=0; i<seqPlaySteps_; i++) {
+      due = start + seqPlayTimes_[i];
+      while (((now = epicsMonotonicGet()) < due) &&
+             (epicsAtomicGetIntT(&seqState_) == seqRunning)) {
+        timeout = (due - now) / 1.e9 - quantum;
+        if (timeout > 0.) {
+          epicsEventWaitWithTimeout(seqEvent_, timeout);
+          burstStart = epicsMonotonicGet();
+        } else if (now - burstStart >= SPIN_BURST) {
+          /* An abort signals the event */
+          epicsEventWaitWithTimeout(seqEvent_, quantum);
+          burstStart = epicsMonotonicGet();
+        }
+      }
+      if (epicsAtomicGetIntT(&seqState_) != seqRunning) break;
+      writeOutputs(seqPlayValues_[i], seqPlayMasks_[i]);
+      if (now > due) {
+        if (now - due > maxLate) maxLate = now - due;
+        sumLate += now - due;
+        if (now - due > tick) late++;
+      }
+    }
+    epicsAtomicCmpAndSwapIntT(&seqState_, seqRunning, seqIdle);
+    asynPrint(pasynUserSelf, ASYN_TRACE_FLOW,
+              "%s:%s:, played %d steps, %d late, max latency=%f us\n", 
+              driverName, functionName, i, late, maxLate / 1.e3);
+    lock();
+    setIntegerParam(seqStateParam_, epicsAtomicGetIntT(&seqState_));
+    setIntegerParam(seqStepsDoneParam_, i);
+    setDoubleParam(seqMaxLatencyParam_, maxLate / 1.e3);
+    setDoubleParam(seqMeanLatencyParam_, (i > 0) ? sumLate / 1.e3 / i : 0.);
+    setIntegerParam(seqLateStepsParam_, late);
+    callParamCallbacks();
+    unlock();
+  }
+}
+
+asynStatus IpUnidig::getBounds(asynUser *pasynUser, epicsInt32 *low, epicsInt32 *high)
+{
+  static const char *functionName = "getBounds";
+  if (modelInfo_->hasDAC)
+  {
+    *low = 0;
+    *high = 4095;
+    return(asynSuccess);
+  } 
+  else 
+  {
+    asynPrint(pasynUser, ASYN_TRACE_ERROR,
+        "%s:%s:, not allowed for this model", 
+        driverName, functionName);
+    return(asynError);
+  }
+}
+ 
+asynStatus IpUnidig::setInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 mask, interruptReason reason)
+{
+  //static const char *functionName = "setInterruptUInt32Digital";
+ 
+  /* Call the base class method to put mask in parameter library so report shows it */
+  asynPortDriver::setInterruptUInt32Digital(pasynUser, mask, reason);
+  
+  switch (reason) {
+    case interruptOnZeroToOne:
+      setInterruptMasks(mask, fallingMask_, polarityMask_);
+      break;
+    case interruptOnOneToZero:
+      setInterruptMasks(risingMask_, mask, polarityMask_);
+      break;
+    case interruptOnBoth:
+      setInterruptMasks(mask, mask, polarityMask_);
+      break;
+  }
+  return(asynSuccess);
+}
+
+asynStatus IpUnidig::clearInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 mask)
+{
+  //static const char *functionName = "clearInterruptUInt32Digital";
+
+  /* Call the base class method to put mask in parameter library so report shows it */
+  asynPortDriver::clearInterruptUInt32Digital(pasynUser, mask);
+
+  setInterruptMasks(risingMask_ & ~mask, fallingMask_ & ~mask, polarityMask_);
+  return(asynSuccess);
+}
+
+asynStatus IpUnidig::getInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 *mask, interruptReason reason)
+{
+  //static const char *functionName = "getInterruptUInt32Digital";
+
+  switch (reason) {
+    case interruptOnZeroToOne:
+      *mask = risingMask_;
+      break;
+    case interruptOnOneToZero:
+      *mask = fallingMask_;
       break;
     case interruptOnBoth:
-      risingMask_ = mask;
-      fallingMask_ = mask;
+      *mask = risingMask_ | fallingMask_;
       break;
   }
-  writeIntEnableRegs();
-  return(asynSuccess);
+  return(asynSuccess);
+}
+
+void IpUnidig::intFunc()
+{
+  ipUnidigRegisters r = regs_;
+  epicsUInt32 inputs=0, pendingLow, pendingHigh, pendingMask, invertMask, mask, storms;
+  ipUnidigMessage msg;
+  epicsUInt64 now;
+  int i;
+
+  /* Time stamp the edge as early as possible */
+  epicsTimeGetCurrentInt(&msg.timeStamp);
+  now = epicsMonotonicGet();
+  msg.usec = (epicsUInt32)(now / 1000);
+  interruptCount_++;
+  isrBusAccesses_ += isrReadCost_;
+
+  /* Clear the interrupts by copying from the interrupt pending register to
+   * the interrupt clear register */
+  *r.intClearRegisterLow = pendingLow = *r.intPendingRegisterLow;
+  *r.intClearRegisterHigh = pendingHigh = *r.intPendingRegisterHigh;
+  pendingMask = pendingLow | (pendingHigh << 16);
+  /* Read the current input.  Don't use read() because that can print debugging. */
+  inputs = readInputs(inputRegs_, &r);
+  msg.bits = inputs;
+  epicsAtomicIncrIntT(&isrCacheSeq_);
+  epicsAtomicWriteMemoryBarrier();
+  isrCacheBits_ = inputs;
+  isrCacheTime_ = now;
+  epicsAtomicWriteMemoryBarrier();
+  epicsAtomicIncrIntT(&isrCacheSeq_);
+  if (ruleOutputMask_) evaluateRules(inputs);
+  msg.interruptMask = pendingMask;
+  /* The polarity register says which edge each pending bit was waiting for */
+  msg.risingMask = pendingMask & polarityMask_;
+  msg.fallingMask = pendingMask & ~polarityMask_;
+  /* Count the edges */
+  storms = 0;
+  for (i=0, mask=pendingMask; mask; i++) {
+    if (!(mask & (1u << i))) continue;
+    mask &= ~(1u << i);
+    if (stormLimit_[i]) {
+      if (now - stormWindowStart_[i] >= STORM_WINDOW) {
+        stormWindowStart_[i] = now;
+        stormCount_[i] = 0;
+      }
+      if (++stormCount_[i] > stormLimit_[i]) {
+        storms |= 1u << i;
+        stormTrips_[i]++;
+        stormChangeTime_[i] = now;
+      }
+    }
+    if (msg.risingMask & (1u << i)) {
+      risingCounts_[i]++;
+      lastRiseUsec_[i] = msg.usec;
+    } else {
+      fallingCounts_[i]++;
+      highTimeUsec_[i] += msg.usec - lastRiseUsec_[i];
+    }
+  }
+  if (storms) {
+    /* Disable the interrupts of the storming bits, the poller takes them over */
+    stormMask_ |= storms;
+    writeIntEnableRegs();
+    isrBusAccesses_ += 2;
+  }
+  if (pendingMask & countLatchMask_) {
+    for (i=0; i<MAX_BITS; i++) {
+      risingLatched_[i] = risingCounts_[i];
+      fallingLatched_[i] = fallingCounts_[i];
+    }
+    epicsAtomicSetIntT(&latchPending_, 1);
+  }
+  if ((epicsAtomicGetIntT(&coalesceSeq_) == coalesceWrittenSeq_) ||
+      (coalesce_ && (ring_.depth() >= RING_HIGH_WATER))) {
+    /* The ring is nearly full, or the coalescing slot has not been claimed yet.
+     * Merge this interrupt into the coalescing slot so the edge is not lost. */
+    coalesceMessage(&msg);
+    messagesCoalesced_++;
+  } else if (ring_.push(&msg)) {
+    messagesSent_++;
+  } else {
+    messagesFailed_++;
+  }
+  if (pendingMask & seqTriggerMask_) triggerSequencer(now);
+  /* Catches edges that are shorter than the capture sample interval */
+  if ((pendingMask & captureEdgeMask_) && (epicsAtomicGetIntT(&captureState_) == captureArmed))
+    epicsAtomicCmpAndSwapIntT(&captureState_, captureArmed, captureTriggered);
+  requestService();
+
+  /* Are there any bits which should generate interrupts on both the rising
+   * and falling edge, and which just generated this interrupt? */
+  invertMask = pendingMask & risingMask_ & fallingMask_;
+  if (invertMask != 0) {
+    /* We want to invert all bits in the polarityMask that are set in 
+     * invertMask. This is done with xor. */
+    polarityMask_ = polarityMask_ ^ invertMask;
+    *r.intPolarityRegisterLow  = (epicsUInt16) polarityMask_;
+    *r.intPolarityRegisterHigh = (epicsUInt16) (polarityMask_ >> 16);
+    isrBusAccesses_ += 2;
+  }
+}
+
+
+void IpUnidig::coalesceMessage(const ipUnidigMessage *msg)
+{
+  /* Merges an interrupt message into the coalescing slot.  Only called from intFunc(). */
+  int seq = epicsAtomicIncrIntT(&coalesceSeq_);
+
+  epicsAtomicWriteMemoryBarrier();
+  if (seq != coalesceWrittenSeq_ + 1) {
+    /* service() has released the slot since the last write, so start afresh */
+    coalescedMask_ = 0;
+    coalescedRising_ = 0;
+    coalescedFalling_ = 0;
+  }
+  coalescedMask_ |= msg->interruptMask;
+  coalescedRising_ |= msg->risingMask;
+  coalescedFalling_ |= msg->fallingMask;
+  coalescedBits_ = msg->bits;
+  coalescedTime_ = msg->timeStamp;
+  coalescedUsec_ = msg->usec;
+  epicsAtomicWriteMemoryBarrier();
+  coalesceWrittenSeq_ = epicsAtomicIncrIntT(&coalesceSeq_);
+}
+
+bool IpUnidig::claimCoalesced(ipUnidigMessage *msg)
+{
+  int seq;
+
+  do {
+    seq = epicsAtomicGetIntT(&coalesceSeq_);
+    /* Nothing new, or intFunc() is writing the slot and will request
+     * service again when it has finished */
+    if ((seq == coalesceClaimedSeq_) || (seq & 1)) return false;
+    epicsAtomicReadMemoryBarrier();
+    msg->bits = coalescedBits_;
+    msg->timeStamp = coalescedTime_;
+    msg->usec = coalescedUsec_;
+    msg->interruptMask = coalescedMask_;
+    msg->risingMask = coalescedRising_;
+    msg->fallingMask = coalescedFalling_;
+    epicsAtomicReadMemoryBarrier();
+    /* Release the slot, unless intFunc() has started another write meanwhile */
+  } while (epicsAtomicCmpAndSwapIntT(&coalesceSeq_, seq, seq+2) != seq);
+  coalesceClaimedSeq_ = seq + 2;
+  return true;
+}
+
+epicsUInt32 IpUnidig::rateLimit(epicsUInt32 interruptMask, epicsUInt64 now, epicsUInt64 *nextDeadline)
+{
+  /* Removes bits from interruptMask that would exceed their maximum callback rate.
+   * Those bits are deferred and delivered, with the latest state, when their
+   * interval has expired.  Returns the mask of bits to do callbacks for now and
+   * lowers *nextDeadline to the time the next deferred bit becomes due. */
+  epicsUInt32 limited = (interruptMask | deferredMask_) & rateLimitedMask_;
+  epicsUInt32 filtered = rateLimitedMask_ & ~limited;
+  epicsUInt32 bit;
+  epicsUInt64 due;
+  int i, edges;
+
+  /* Edges that debouncing has already filtered are not suppressed here */
+  for (i=0; filtered; i++) {
+    if (!(filtered & (1u << i))) continue;
+    filtered &= ~(1u << i);
+    limitedEdges_[i] = 0;
+  }
+  /* Bits that were deferred but are no longer limited are delivered now */
+  interruptMask |= deferredMask_ & ~rateLimitedMask_;
+  deferredMask_ &= rateLimitedMask_;
+  for (i=0; limited; i++) {
+    bit = 1u << i;
+    if (!(limited & bit)) continue;
+    limited &= ~bit;
+    edges = limitedEdges_[i];
+    limitedEdges_[i] = 0;
+    due = lastCallbackTime_[i] + minCallbackInterval_[i];
+    if (now >= due) {
+      /* The callback delivers the last edge, the others in this pass are
+       * suppressed.  With no new edges it delivers the last deferred one. */
+      if (edges > 0)
+        suppressedEdges_[i] += edges - 1;
+      else if ((deferredMask_ & bit) && (suppressedEdges_[i] > 0))
+        suppressedEdges_[i]--;
+      if ((deferredMask_ & bit) || (edges > 1)) {
+        /* Publish the suppressed count at the capped rate along with the bit */
+        setIntegerParam(i, suppressedEdgesParam_, suppressedEdges_[i]);
+        callParamCallbacks(i);
+      }
+      interruptMask |= bit;
+      deferredMask_ &= ~bit;
+      lastCallbackTime_[i] = now;
+    } else {
+      suppressedEdges_[i] += edges;
+      interruptMask &= ~bit;
+      deferredMask_ |= bit;
+      if (due < *nextDeadline) *nextDeadline = due;
+    }
+  }
+  return interruptMask;
+}
+
+void IpUnidig::countLimitedEdges(epicsUInt32 edges, epicsUInt32 doubleEdges)
+{
+  /* Counts the edges of the rate limited bits for rateLimit().  A bit in
+   * doubleEdges changed twice, in a coalesced message. */
+  int i;
+
+  edges &= rateLimitedMask_;
+  for (i=0; edges; i++) {
+    if (!(edges & (1u << i))) continue;
+    edges &= ~(1u << i);
+    limitedEdges_[i] += 1 + ((doubleEdges >> i) & 1);
+  }
+}
+
+void IpUnidig::addEvent(const epicsTimeStamp *timeStamp, epicsUInt32 bits, int bit, int direction)
+{
+  ipUnidigEvent *pEvent;
+
+  if (!events_) {
+    /* Cards whose inputs never change do not need the history */
+    events_ = (ipUnidigEvent *)callocMustSucceed(SOE_SIZE, sizeof(ipUnidigEvent), "IpUnidig::addEvent");
+    SOETimeStamps_ = (epicsFloat64 *)callocMustSucceed(SOE_SIZE, sizeof(epicsFloat64), "IpUnidig::addEvent");
+    SOEBits_ = (epicsInt32 *)callocMustSucceed(SOE_SIZE, sizeof(epicsInt32), "IpUnidig::addEvent");
+    SOEDirections_ = (epicsInt32 *)callocMustSucceed(SOE_SIZE, sizeof(epicsInt32), "IpUnidig::addEvent");
+    SOEInputs_ = (epicsInt32 *)callocMustSucceed(SOE_SIZE, sizeof(epicsInt32), "IpUnidig::addEvent");
+  }
+  pEvent = &events_[numEvents_ & (SOE_SIZE-1)];
+  pEvent->timeStamp = *timeStamp;
+  pEvent->bit = bit;
+  pEvent->direction = direction;
+  pEvent->inputs = bits;
+  numEvents_++;
+}
+
+void IpUnidig::addEvents(const epicsTimeStamp *timeStamp, epicsUInt32 bits, epicsUInt32 risingMask, epicsUInt32 fallingMask)
+{
+  epicsUInt32 eventMask = risingMask | fallingMask;
+  epicsUInt32 bothMask = risingMask & fallingMask;
+  int i;
+
+  for (i=0; eventMask; i++) {
+    if (!(eventMask & (1u << i))) continue;
+    eventMask &= ~(1u << i);
+    if (bothMask & (1u << i)) {
+      /* A coalesced message can have both edges, the final state gives their order */
+      addEvent(timeStamp, bits, i, !((bits >> i) & 1));
+      addEvent(timeStamp, bits, i, (bits >> i) & 1);
+    } else {
+      addEvent(timeStamp, bits, i, (risingMask >> i) & 1);
+    }
+  }
+}
+
+size_t IpUnidig::copyEvents(epicsUInt32 first, epicsUInt32 last)
+{
+  /* Copies events [first, last) from the history into the waveform arrays */
+  ipUnidigEvent *pEvent;
+  size_t n = 0;
+
+  for (; first != last; first++, n++) {
+    pEvent = &events_[first & (SOE_SIZE-1)];
+    SOETimeStamps_[n] = pEvent->timeStamp.secPastEpoch + pEvent->timeStamp.nsec/1.e9;
+    SOEBits_[n]       = pEvent->bit;
+    SOEDirections_[n] = pEvent->direction;
+    SOEInputs_[n]     = (epicsInt32)pEvent->inputs;
+  }
+  return n;
+}
+
+void IpUnidig::publishEvents(epicsUInt32 first)
+{
+  /* Does one set of array callbacks with the events added since first */
+  size_t n;
+
+  if (numEvents_ - first > SOE_SIZE) first = numEvents_ - SOE_SIZE;
+  n = copyEvents(first, numEvents_);
+  setTimeStamp(&events_[(numEvents_-1) & (SOE_SIZE-1)].timeStamp);
+  doCallbacksFloat64Array(SOETimeStamps_, n, SOETimeStampParam_, 0);
+  doCallbacksInt32Array(SOEBits_,       n, SOEBitParam_,       0);
+  doCallbacksInt32Array(SOEDirections_, n, SOEDirectionParam_, 0);
+  doCallbacksInt32Array(SOEInputs_,     n, SOEInputParam_,     0);
+  setIntegerParam(SOENumEventsParam_, numEvents_ > SOE_SIZE ? SOE_SIZE : numEvents_);
+}
+
+void IpUnidig::processSample(const ipUnidigMessage *msg, epicsUInt32 prevBits)
+{
+  /* Handles one input sample, either an interrupt message or a poll */
+  epicsUInt32 changedBits = msg->bits ^ prevBits;
+  epicsUInt32 polledRising, polledFalling;
+  int latch = 0;
+  int i;
+
+  if (!haveSample_) {
+    /* The first sample only establishes the initial state.  Inputs that are
+     * already high are treated as having just risen for the duty cycle. */
+    haveSample_ = 1;
+    changedBits = 0;
+    for (i=0; i<MAX_BITS; i++) {
+      if (msg->bits & (1u << i)) lastRiseUsec_[i] = msg->usec;
+    }
+  }
+  addEvents(&msg->timeStamp, msg->bits,
+            msg->risingMask  | (changedBits & ~msg->interruptMask &  msg->bits),
+            msg->fallingMask | (changedBits & ~msg->interruptMask & ~msg->bits));
+
+  /* Count the edges that intFunc() does not see */
+  polledRising  = changedBits &  msg->bits & ~(interruptsEnabled_ ? (risingMask_ & ~stormMask_) : 0);
+  polledFalling = changedBits & ~msg->bits & ~(interruptsEnabled_ ? (fallingMask_ & ~stormMask_) : 0);
+  if ((polledRising | polledFalling) & countLatchMask_) latch = 1;
+  for (i=0; polledRising | polledFalling; i++) {
+    if (polledRising & (1u << i)) {
+      risingCounts_[i]++;
+      lastRiseUsec_[i] = msg->usec;
+    }
+    if (polledFalling & (1u << i)) {
+      fallingCounts_[i]++;
+      highTimeUsec_[i] += msg->usec - lastRiseUsec_[i];
+    }
+    polledRising &= ~(1u << i);
+    polledFalling &= ~(1u << i);
+  }
+  if (latch) latchCounts();
+}
+
+void IpUnidig::latchCounts()
+{
+  int i;
+
+  for (i=0; i<MAX_BITS; i++) {
+    risingLatched_[i] = risingCounts_[i];
+    fallingLatched_[i] = fallingCounts_[i];
+  }
+  epicsAtomicSetIntT(&latchPending_, 1);
+}
+
+void IpUnidig::publishCounts(int latched)
+{
+  /* Updates the counter parameters, relative to the last reset.  Callbacks are
+   * only done for addresses where something changed. */
+  int i;
+
+  for (i=0; i<MAX_BITS; i++) {
+    setIntegerParam(i, risingCountParam_,
+                    (epicsInt32)(risingCounts_[i] - risingBase_[i]));
+    setIntegerParam(i, fallingCountParam_,
+                    (epicsInt32)(fallingCounts_[i] - fallingBase_[i]));
+    if (latched) {
+      setIntegerParam(i, risingLatchedParam_,  (epicsInt32)(risingLatched_[i] - risingBase_[i]));
+      setIntegerParam(i, fallingLatchedParam_, (epicsInt32)(fallingLatched_[i] - fallingBase_[i]));
+    }
+    setIntegerParam(i, glitchCountParam_, (epicsInt32)glitchCounts_[i]);
+    setIntegerParam(i, stormTripsParam_, (epicsInt32)stormTrips_[i]);
+    if (i < numRules_) setIntegerParam(i, ruleHitsParam_, (epicsInt32)rules_[i].hits);
+    publishPulse(i);
+    callParamCallbacks(i);
+  }
+}
+
+void IpUnidig::publishPulse(int bit)
+{
+  /* The jitter is the standard deviation of the achieved widths */
+  ipUnidigPulse *pPulse = &pulses_[bit];
+  double mean, jitter = 0.;
+
+  epicsMutexMustLock(pulseLock_);
+  if (pPulse->numPulses > 0) {
+    mean = pPulse->sumError / pPulse->numPulses;
+    jitter = pPulse->sumError2 / pPulse->numPulses - mean * mean;
+    jitter = (jitter > 0.) ? sqrt(jitter) : 0.;
+  }
+  setIntegerParam(bit, pulseActiveParam_, pPulse->active);
+  setDoubleParam(bit, pulseActualWidthParam_, pPulse->lastWidth / 1.e9);
+  setDoubleParam(bit, pulseJitterParam_, jitter / 1.e9);
+  setIntegerParam(bit, pulseLateParam_, (epicsInt32)pPulse->lateEdges);
+  epicsMutexUnlock(pulseLock_);
+}
+
+void IpUnidig::publishFrequencies(epicsUInt32 nowUsec, epicsUInt32 bits)
+{
+  /* Computes the frequency, period and duty cycle of each bit over the gate
+   * that has just ended and starts the next gate */
+  epicsUInt32 gateUsec = nowUsec - gateStartUsec_;
+  epicsUInt32 rising, highUsec, openUsec;
+  epicsInt32 netHighUsec;
+  double frequency;
+  int i;
+
+  if (gateUsec == 0) return;
+  for (i=0; i<MAX_BITS; i++) {
+    rising = risingCounts_[i] - gateRisingCounts_[i];
+    gateRisingCounts_[i] += rising;
+    highUsec = highTimeUsec_[i] - gateHighTimeUsec_[i];
+    gateHighTimeUsec_[i] += highUsec;
+    /* A high period that is still open is credited to this gate, and the
+     * credit is taken back from the gate in which the falling edge occurs */
+    openUsec = (bits & (1u << i)) ? nowUsec - lastRiseUsec_[i] : 0;
+    netHighUsec = (epicsInt32)(highUsec - gateOpenUsec_[i] + openUsec);
+    gateOpenUsec_[i] = openUsec;
+    if (netHighUsec < 0) netHighUsec = 0;
+    if ((epicsUInt32)netHighUsec > gateUsec) netHighUsec = gateUsec;
+    frequency = rising / (gateUsec / 1.e6);
+    setDoubleParam(i, frequencyParam_, frequency);
+    setDoubleParam(i, periodParam_, (rising > 0) ? 1./frequency : 0.);
+    setDoubleParam(i, dutyCycleParam_, 100. * netHighUsec / gateUsec);
+    callParamCallbacks(i);
+  }
+  gateStartUsec_ = nowUsec;
+}
+
+void IpUnidig::pollerThread()
+{
+  /* This function runs in a separate thread when there is no shared
+   * scheduler.  It waits for the poll time, or an interrupt, whichever
+   * comes first, and then services the card. */
+  epicsUInt64 now, nextDeadline;
+  double timeout;
+
+  nextDeadline = epicsMonotonicGet();
+  while(1) {
+    /*  Wait for an interrupt, the poll time, or a deferred callback, whichever
+     *  comes first */
+    now = epicsMonotonicGet();
+    timeout = (nextDeadline > now) ? (nextDeadline - now) / 1.e9 : 0.;
+    epicsEventWaitWithTimeout(wakeEvent_, timeout);
+    nextDeadline = service();
+  }
+}
+
+void IpUnidig::requestService()
+{
+  /* Called from intFunc() as well as from threads */
+  if (scheduler_) {
+    epicsAtomicSetIntT(&serviceRequested_, 1);
+    scheduler_->wakeUp();
+  } else {
+    epicsEventSignal(wakeEvent_);
+  }
+}
+
+epicsUInt32 IpUnidig::pollMask()
+{
+  /* The inputs that need polling are those which don't interrupt on both
+   * edges */
+  epicsUInt32 covered = interruptsEnabled_ ? (risingMask_ & fallingMask_ & ~stormMask_) : 0;
+  return inputMask_ & ~covered;
+}
+
+epicsUInt32 IpUnidig::pollInputs(epicsUInt32 knownBits, epicsUInt32 mask)
+{
+  /* Reads only the half-words which contain bits in mask.  The other bits
+   * are kept up to date by the interrupt routine, so they are taken from
+   * knownBits.  The first poll reads everything. */
+  ipUnidigRegisters r = regs_;
+  epicsUInt32 readMask, bits;
+  int low, high;
+
+  if (rebooting_) epicsThreadSuspendSelf();
+  if (!haveSample_) mask = 0xffffffff;
+  low = (mask & 0xffff) && r.inputRegisterLow;
+  high = (mask >> 16) && r.inputRegisterHigh;
+  if (!low && !high) {
+    /* All the inputs interrupt on both edges, so knownBits is current */
+    pollReadsSkipped_++;
+    cacheBits_ = knownBits;
+    cacheTime_ = epicsMonotonicGet();
+    return knownBits;
+  }
+  epicsAtomicAddIntT(&busAccesses_, low + high);
+  readMask = (low ? 0xffff : 0) | (high ? 0xffff0000 : 0);
+  bits = (knownBits & ~readMask) | (readInputs((low ? REGS_LOW : 0) | (high ? REGS_HIGH : 0), &r) & readMask);
+  /* The bits that were not read are kept current by interrupts */
+  cacheBits_ = bits;
+  cacheTime_ = epicsMonotonicGet();
+  return bits;
+}
+
+void IpUnidig::adaptPollPeriod(int changed)
+{
+  /* Back off while nothing changes, go back to the fastest rate on activity */
+  if (changed) {
+    pollPeriod_ = pollTime_;
+  } else {
+    pollPeriod_ *= 2.;
+    if (pollPeriod_ > pollMaxPeriod_) pollPeriod_ = pollMaxPeriod_;
+  }
+}
+
+int IpUnidig::takeServiceRequest()
+{
+  return epicsAtomicCmpAndSwapIntT(&serviceRequested_, 1, 0);
+}
+
+epicsUInt64 IpUnidig::service()
+{
+  /* Processes the interrupt messages and polls the bits if the poll time
+   * has expired.  If the bits have changed then it does callbacks to all
+   * clients that have registered with registerDevCallback.  Returns the
+   * time at which the card next needs service. */
+  epicsUInt32 newBits, changedBits, interruptMask, firstEvent, polledBits, outBits;
+  ipUnidigMessage msg;
+  epicsTimeStamp sampleTime;
+  int nMessages;
+  epicsUInt64 now, nextDeadline, elapsed;
+  epicsUInt32 doneUsec, latency;
+  int i, bucket;
+  static const char *functionName = "service";
+
+  lock();
+  now = epicsMonotonicGet();
+  queueDepth_ = (int)ring_.depth() + ((epicsAtomicGetIntT(&coalesceSeq_) != coalesceClaimedSeq_) ? 1 : 0);
+  if (queueDepth_ > queueHighWater_) queueHighWater_ = queueDepth_;
+  newBits = oldBits_;
+  interruptMask = 0;
+  nMessages = 0;
+  /* Time of the last sample in this pass, if there was one */
+  sampleTime.secPastEpoch = 0;
+  sampleTime.nsec = 0;
+  firstEvent = numEvents_;
+  /* Drain everything intFunc() has queued since the last wakeup.  The
+   * coalescing slot is always newer than anything in the ring.  The limit
+   * keeps an interrupt storm from holding the lock indefinitely. */
+  while ((nMessages <= RING_SIZE) && (ring_.pop(&msg) || claimCoalesced(&msg))) {
+    batchUsec_[nMessages] = msg.usec;
+    nMessages++;
+    /* We detect change both from interruptMask (which only works for
+     * interrupts) and changedBits, which works for polling */
+    changedBits = msg.bits ^ newBits;
+    interruptMask |= msg.interruptMask | changedBits;
+    processSample(&msg, newBits);
+    if (changedBits & debounceMask_) debounceSample(msg.bits, newBits, msg.usec);
+    if (rateLimitedMask_ & (changedBits | msg.risingMask | msg.fallingMask))
+      countLimitedEdges(changedBits | msg.risingMask | msg.fallingMask, msg.risingMask & msg.fallingMask);
+    if (shm_ || log_) publishEvent(&msg);
+    sampleTime = msg.timeStamp;
+    newBits = msg.bits;
+  }
+  polledBits = pollMask();
+  if (nMessages > 0) {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
+              "%s:%s:, got %d interrupt messages\n",
+              driverName, functionName, nMessages);
+    /* The interrupt routine reads all the inputs, so it can see the polled
+     * bits change too */
+    if ((newBits ^ oldBits_) & polledBits) adaptPollPeriod(1);
+    nextPoll_ = now + (epicsUInt64)(pollPeriod_ * 1.e9);
+  } else if (now >= nextPoll_) {
+    /* The poll time expired with no interrupt, so we need
+     * to read the bits.  If there was an interrupt the bits got
+     * set in the interrupt routines */
+    msg.bits = pollInputs(oldBits_, polledBits);
+    epicsTimeGetCurrent(&msg.timeStamp);
+    msg.usec = (epicsUInt32)(now / 1000);
+    msg.interruptMask = 0;
+    msg.risingMask = 0;
+    msg.fallingMask = 0;
+    processSample(&msg, oldBits_);
+    if ((msg.bits ^ oldBits_) & debounceMask_) debounceSample(msg.bits, oldBits_, msg.usec);
+    if ((shm_ || log_) && (msg.bits != oldBits_)) publishEvent(&msg);
+    sampleTime = msg.timeStamp;
+    newBits = msg.bits;
+    interruptMask = newBits ^ oldBits_;
+    if (rateLimitedMask_ & interruptMask) countLimitedEdges(interruptMask, 0);
+    adaptPollPeriod((interruptMask & polledBits) != 0);
+    nextPoll_ = now + (epicsUInt64)(pollPeriod_ * 1.e9);
+  }
+  if (stormMask_ | stormPublishedMask_) checkStorms(now, newBits, oldBits_);
+  /* intFunc() has already evaluated the rules for its messages, with all
+   * the inputs, but a poll can find polled inputs that changed since */
+  if (ruleOutputMask_ && (nMessages == 0) && (newBits != oldBits_)) evaluateRulesNow();
+  setDoubleParam(pollCurrentPeriodParam_, pollPeriod_);
+  setIntegerParam(pollMaskParam_, polledBits);
+
+  asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,
+            "%s:%s:, bits=%x, oldBits=%x, interruptMask=%x\n", 
+            driverName, functionName, newBits, oldBits_, interruptMask);
+
+  if (forceCallback_) interruptMask = 0xffffff;
+  if (now >= nextStats_) {
+    publishCounts(epicsAtomicCmpAndSwapIntT(&latchPending_, 1, 0));
+    setIntegerParam(outputAccessesSavedParam_, outputAccessesSaved_);
+    setIntegerParam(messagesSentParam_, messagesSent_);
+    setIntegerParam(messagesFailedParam_, messagesFailed_);
+    setIntegerParam(messagesCoalescedParam_, messagesCoalesced_);
+    /* Service times are for the passes since the last statistics update */
+    setDoubleParam(serviceTimeParam_, serviceCount_ ? serviceTimeSum_ / 1.e3 / serviceCount_ : 0.);
+    setDoubleParam(serviceMaxTimeParam_, serviceTimeMax_ / 1.e3);
+    serviceTimeSum_ = 0;
+    serviceTimeMax_ = 0;
+    serviceCount_ = 0;
+    publishPerformance(now);
+    /* intFunc() flips the polarity of the bits that interrupt on both edges */
+    setIntegerParam(polarityParam_, polarityMask_);
+    if (log_) {
+      setIntegerParam(logFreezeParam_, ipUnidigEventLogFrozen(log_));
+      setIntegerParam(logCountParam_, (epicsInt32)ipUnidigEventLogCount(log_));
+    }
+    nextStats_ = now + (epicsUInt64)(statsPeriod_ * 1.e9);
+  } else if (epicsAtomicCmpAndSwapIntT(&latchPending_, 1, 0)) {
+    /* Latched values are published as soon as the trigger has been seen */
+    publishCounts(1);
+  }
+  if (now >= nextGate_) {
+    publishFrequencies((epicsUInt32)(now / 1000), newBits);
+    nextGate_ = now + (epicsUInt64)(gateTime_ * 1.e9);
+  }
+  nextDeadline = (nextStats_ < nextPoll_) ? nextStats_ : nextPoll_;
+  if (nextGate_ < nextDeadline) nextDeadline = nextGate_;
+  if (stagedMask_ && !outputTransaction_) {
+    if (now >= outputFlushTime_) {
+      flushOutputs();
+    } else if (outputFlushTime_ < nextDeadline) {
+      nextDeadline = outputFlushTime_;
+    }
+  }
+  outBits = newBits;
+  if (debounceMask_) {
+    outBits = debounceInputs(newBits, &interruptMask, now, &nextDeadline);
+  }
+  if (rateLimitedMask_ | deferredMask_) {
+    interruptMask = rateLimit(interruptMask, now, &nextDeadline);
+  }
+  if (nMessages > RING_SIZE) {
+    /* There is more to drain, don't wait for the next interrupt */
+    nextDeadline = now;
+  }
+  /* The parameter always holds the latest state, even for deferred bits, so
+   * synchronous reads are never stale */
+  oldBits_ = newBits;
+  if (shm_ && sampleTime.secPastEpoch) {
+    ipUnidigShmWriteState(shm_, newBits, outputShadow_,
+                          sampleTime.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH, sampleTime.nsec);
+  }
+  if (outBits != publishedBits_ || interruptMask) {
+    publishedBits_ = outBits;
+    forceCallback_ = 0;
+    asynPortDriver::setUIntDigitalParam(digitalInputParam_, outBits, 0xFFFFFFFF, interruptMask);
+    if (interruptMask) callbackCount_++;
+  }
+  if (numEvents_ != firstEvent) publishEvents(firstEvent);
+  if (bitAddressing_ && interruptMask) publishInputBits(outBits, interruptMask);
+  /* intFunc() can have started the sequencer */
+  setIntegerParam(seqStateParam_, epicsAtomicGetIntT(&seqState_));
+  /* One callback pass for the whole batch */
+  callParamCallbacks();
+  /* The interrupt messages are complete once their callbacks have been done */
+  doneUsec = (epicsUInt32)(epicsMonotonicGet() / 1000);
+  for (i=0; i<nMessages; i++) {
+    latency = doneUsec - batchUsec_[i];
+    for (bucket=0; latency && (bucket < LATENCY_BUCKETS-1); bucket++) latency >>= 1;
+    latencyHistogram_[bucket]++;
+  }
+  elapsed = epicsMonotonicGet() - now;
+  serviceTimeSum_ += elapsed;
+  if (elapsed > serviceTimeMax_) serviceTimeMax_ = elapsed;
+  serviceCount_++;
+  unlock();
+  return nextDeadline;
 }
 
-asynStatus IpUnidig::clearInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 mask)
+void IpUnidig::publishPerformance(epicsUInt64 now)
 {
-  //static const char *functionName = "clearInterruptUInt32Digital";
+  /* Computes the rates since the last statistics update and publishes them
+   * with the queue, latency and lock statistics */
+  epicsUInt32 interrupts = interruptCount_;
+  epicsUInt32 accesses = isrBusAccesses_ + (epicsUInt32)epicsAtomicGetIntT(&busAccesses_);
+  double seconds = (now - lastStatsTime_) / 1.e9;
 
-  /* Call the base class method to put mask in parameter library so report shows it */
-  asynPortDriver::clearInterruptUInt32Digital(pasynUser, mask);
+  if (seconds <= 0.) return;
+  interruptRate_ = (interrupts - lastInterruptCount_) / seconds;
+  callbackRate_  = (callbackCount_ - lastCallbackCount_) / seconds;
+  busAccessRate_ = (accesses - lastBusAccesses_) / seconds;
+  lastInterruptCount_ = interrupts;
+  lastCallbackCount_ = callbackCount_;
+  lastBusAccesses_ = accesses;
+  lastStatsTime_ = now;
+  setDoubleParam(interruptRateParam_, interruptRate_);
+  setDoubleParam(callbackRateParam_, callbackRate_);
+  setDoubleParam(busAccessRateParam_, busAccessRate_);
+  setIntegerParam(queueDepthParam_, queueDepth_);
+  setIntegerParam(queueHighWaterParam_, queueHighWater_);
+  /* Lock hold times are for the periods since the last statistics update */
+  setDoubleParam(lockHoldTimeParam_, lockHoldCount_ ? lockHoldSum_ / 1.e3 / lockHoldCount_ : 0.);
+  setDoubleParam(lockHoldMaxTimeParam_, lockHoldMax_ / 1.e3);
+  lockHoldSum_ = 0;
+  lockHoldMax_ = 0;
+  lockHoldCount_ = 0;
+  doCallbacksInt32Array(latencyHistogram_, LATENCY_BUCKETS, latencyHistogramParam_, 0);
+}
+
+asynStatus IpUnidig::setDebounce(epicsUInt32 mask, double seconds)
+{
+  /* Sets the debounce time of the bits in mask.  A time of 0 turns debouncing
+   * off, once any change that is being held back has been published.  Only
+   * input bits can be debounced. */
+  static const char *functionName = "setDebounce";
+  int i;
 
-  risingMask_ &= ~mask;
-  fallingMask_ &= ~mask;
-  writeIntEnableRegs();
+  if (mask & ~inputMask_) {
+    asynPrint(pasynUserSelf, ASYN_TRACE_ERROR,
+              "%s:%s:, mask %x includes bits which are not inputs\n", 
+              driverName, functionName, mask);
+    return(asynError);
+  }
+  if (seconds < 0.) seconds = 0.;
+  if (seconds > 60.) seconds = 60.;
+  lock();
+  for (i=0; i<MAX_BITS; i++) {
+    if (!(mask & (1u << i))) continue;
+    debounceUsec_[i] = (epicsUInt32)(seconds * 1.e6);
+    if (seconds > 0.) debounceMask_ |= (1u << i);
+    setDoubleParam(i, debounceTimeParam_, seconds);
+    callParamCallbacks(i);
+  }
+  unlock();
+  requestService();
   return(asynSuccess);
 }
 
-asynStatus IpUnidig::getInterruptUInt32Digital(asynUser *pasynUser, epicsUInt32 *mask, interruptReason reason)
+void IpUnidig::debounceSample(epicsUInt32 bits, epicsUInt32 prevBits, epicsUInt32 usec)
 {
-  //static const char *functionName = "getInterruptUInt32Digital";
+  /* An edge away from the published state starts or restarts the stability
+   * timer of the bit, an edge back to it is a glitch */
+  epicsUInt32 changed = (bits ^ prevBits) & debounceMask_;
+  int i;
 
-  switch (reason) {
-    case interruptOnZeroToOne:
-      *mask = risingMask_;
-      break;
-    case interruptOnOneToZero:
-      *mask = fallingMask_;
-      break;
-    case interruptOnBoth:
-      *mask = risingMask_ | fallingMask_;
-      break;
+  for (i=0; changed; i++) {
+    if (!(changed & (1u << i))) continue;
+    changed &= ~(1u << i);
+    if ((bits ^ publishedBits_) & (1u << i))
+      changeUsec_[i] = usec;
+    else
+      glitchCounts_[i]++;
   }
-  return(asynSuccess);
 }
 
-void IpUnidig::intFunc()
+epicsUInt32 IpUnidig::debounceInputs(epicsUInt32 bits, epicsUInt32 *interruptMask, epicsUInt64 now, epicsUInt64 *nextDeadline)
 {
-  ipUnidigRegisters r = regs_;
-  epicsUInt32 inputs=0, pendingLow, pendingHigh, pendingMask, invertMask;
-  ipUnidigMessage msg;
+  /* Returns bits with the debounced bits that have not been stable for their
+   * debounce time held at their published state, and removes them from
+   * *interruptMask.  Lowers *nextDeadline to when the next one is due.  Bits
+   * that interrupt on both edges are known to be stable until the next
+   * interrupt, the others are polled again when they are due. */
+  epicsUInt32 mask = debounceMask_;
+  epicsUInt32 debounced = mask;
+  epicsUInt32 pending = (bits ^ publishedBits_) & mask;
+  epicsUInt32 polled = pollMask();
+  epicsUInt32 nowUsec = (epicsUInt32)(now / 1000);
+  epicsUInt32 accepted = 0, held, bit;
+  epicsUInt64 due;
+  int i;
 
-  /* Clear the interrupts by copying from the interrupt pending register to
-   * the interrupt clear register */
-  *r.intClearRegisterLow = pendingLow = *r.intPendingRegisterLow;
-  *r.intClearRegisterHigh = pendingHigh = *r.intPendingRegisterHigh;
-  pendingMask = pendingLow | (pendingHigh << 16);
-  /* Read the current input.  Don't use read() because that can print debugging. */
-  if (r.inputRegisterLow)  inputs = (epicsUInt32) *r.inputRegisterLow;
-  if (r.inputRegisterHigh) inputs |= (epicsUInt32) (*r.inputRegisterHigh << 16);
-  msg.bits = inputs;
-  msg.interruptMask = pendingMask;
-  if (epicsMessageQueueTrySend(msgQId_, &msg, sizeof(msg)) == 0)
-    messagesSent_++;
-  else
-    messagesFailed_++;
+  for (i=0; debounced; i++) {
+    bit = 1u << i;
+    if (!(debounced & bit)) continue;
+    debounced &= ~bit;
+    if (!(pending & bit)) {
+      if (debounceUsec_[i] == 0) debounceMask_ &= ~bit;
+      continue;
+    }
+    held = nowUsec - changeUsec_[i];
+    if (held >= debounceUsec_[i]) {
+      accepted |= bit;
+      continue;
+    }
+    due = now + (epicsUInt64)(debounceUsec_[i] - held) * 1000;
+    if (due < *nextDeadline) *nextDeadline = due;
+    if ((polled & bit) && (due < nextPoll_)) nextPoll_ = due;
+  }
+  /* Glitches that are over don't do callbacks either */
+  *interruptMask = (*interruptMask & ~mask) | accepted;
+  pending &= ~accepted;
+  return (bits & ~pending) | (publishedBits_ & pending);
+}
 
-  /* Are there any bits which should generate interrupts on both the rising
-   * and falling edge, and which just generated this interrupt? */
-  invertMask = pendingMask & risingMask_ & fallingMask_;
-  if (invertMask != 0) {
-    /* We want to invert all bits in the polarityMask that are set in 
-     * invertMask. This is done with xor. */
-    polarityMask_ = polarityMask_ ^ invertMask;
-    *r.intPolarityRegisterLow  = (epicsUInt16) polarityMask_;
-    *r.intPolarityRegisterHigh = (epicsUInt16) (polarityMask_ >> 16);
+void IpUnidig::publishInputBits(epicsUInt32 bits, epicsUInt32 interruptMask)
+{
+  /* In bit addressing mode DIGITAL_INPUT at address N (1-31) holds only bit N,
+   * so its clients are only called when bit N interrupts.  Address 0 is
+   * published by service() for all the bits, as in the mask based mode. */
+  epicsUInt32 bit;
+  int addr;
+
+  for (addr=1; addr<MAX_BITS; addr++) {
+    bit = 1u << addr;
+    if (!(interruptMask & bit)) continue;
+    setUIntDigitalParam(addr, digitalInputParam_, bits, bit, bit);
+    callParamCallbacks(addr);
   }
 }
 
-
-void IpUnidig::pollerThread()
+asynStatus IpUnidig::lock()
 {
-  /* This function runs in a separate thread.  It waits for the poll
-   * time, or an interrupt, whichever comes first.  If the bits read from
-   * the ipUnidig have changed then it does callbacks to all clients that
-   * have registered with registerDevCallback */
-  //static const char *functionName = "pollerThread";
-  epicsUInt32 newBits, changedBits, interruptMask=0;
-  ipUnidigMessage msg;
-  int status;
-  static const char *functionName = "pollerThread";
-
-  while(1) {
-    /*  Wait for an interrupt or for the poll time, whichever comes first */
-    status = epicsMessageQueueReceiveWithTimeout(msgQId_, 
-                                            &msg, sizeof(msg), 
-                                            pollTime_);
-    lock();
-    if (status == -1) {
-      /* The wait timed out, so there was no interrupt, so we need
-       * to read the bits.  If there was an interrupt the bits got
-       * set in the interrupt routines */
-      readUInt32Digital(this->pasynUserSelf, &newBits, 0xffffffff);
-      interruptMask = 0;
-    } else {
-      newBits = msg.bits;
-      interruptMask = msg.interruptMask;
-      asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,
-                "%s:%s:, got interrupt\n",
-                driverName, functionName);
+  /* Times how long the port lock is held.  The asynPortDriver interface
+   * functions call this too, so record processing is included. */
+  asynStatus status = asynPortDriver::lock();
+
+  if (lockDepth_++ == 0) lockTime_ = epicsMonotonicGet();
+  return status;
+}
+
+asynStatus IpUnidig::unlock()
+{
+  epicsUInt64 held;
+
+  if (--lockDepth_ == 0) {
+    held = epicsMonotonicGet() - lockTime_;
+    lockHoldSum_ += held;
+    if (held > lockHoldMax_) lockHoldMax_ = held;
+    lockHoldCount_++;
+  }
+  return asynPortDriver::unlock();
+}
+
+ipUnidigScheduler::ipUnidigScheduler(int numThreads, int priority)
+  : numCards_(0), nextCard_(0), numThreads_(numThreads)
+{
+  int i;
+  char name[32];
+
+  lock_ = epicsMutexMustCreate();
+  wakeEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  for (i=0; i<numThreads_; i++) {
+    sprintf(name, "ipUnidigSched%d", i);
+    epicsThreadCreate(name,
+                      priority,
+                      epicsThreadGetStackSize(epicsThreadStackBig),
+                      (EPICSTHREADFUNC)schedulerThreadC,
+                      this);
+  }
+}
+
+void ipUnidigScheduler::addCard(IpUnidig *pCard)
+{
+  epicsMutexMustLock(lock_);
+  if (numCards_ < MAX_IP_UNIDIG_CARDS) {
+    cards_[numCards_] = pCard;
+    deadlines_[numCards_] = epicsMonotonicGet();
+    inService_[numCards_] = 0;
+    numCards_++;
+  } else {
+    errlogPrintf("ipUnidigScheduler: too many cards\n");
+  }
+  epicsMutexUnlock(lock_);
+  wakeUp();
+}
+
+void ipUnidigScheduler::workerThread()
+{
+  /* Each pass services the first card, starting after the last one
+   * serviced, whose deadline has passed or which has a service request.
+   * If there is none the worker sleeps until the earliest deadline. */
+  epicsUInt64 now, nextDeadline, deadline;
+  int i, n, card;
+
+  epicsMutexMustLock(lock_);
+  while(1) {
+    now = epicsMonotonicGet();
+    nextDeadline = now + 1000000000;
+    card = -1;
+    for (n=0; n<numCards_; n++) {
+      i = (nextCard_ + n) % numCards_;
+      if (inService_[i]) continue;
+      if ((deadlines_[i] <= now) || cards_[i]->takeServiceRequest()) {
+        card = i;
+        break;
+      }
+      if (deadlines_[i] < nextDeadline) nextDeadline = deadlines_[i];
     }
+    if (card < 0) {
+      epicsMutexUnlock(lock_);
+      epicsEventWaitWithTimeout(wakeEvent_, (nextDeadline - now) / 1.e9);
+      epicsMutexMustLock(lock_);
+      continue;
+    }
+    inService_[card] = 1;
+    nextCard_ = card + 1;
+    epicsMutexUnlock(lock_);
+    /* There may be more cards ready for another worker */
+    if (numThreads_ > 1) wakeUp();
+    deadline = cards_[card]->service();
+    epicsMutexMustLock(lock_);
+    deadlines_[card] = deadline;
+    inService_[card] = 0;
+  }
+}
 
-    asynPrint(this->pasynUserSelf, ASYN_TRACEIO_DRIVER,
-              "%s:%s:, bits=%x, oldBits=%x, interruptMask=%x\n", 
-              driverName, functionName, newBits, oldBits_, interruptMask);
+void ipUnidigScheduler::report(FILE *fp)
+{
+  fprintf(fp, "  serviced by the shared scheduler, %d threads, %d cards\n",
+          numThreads_, numCards_);
+}
 
-    /* We detect change both from interruptMask (which only works for
-     * interrupts) and changedBits, which works for polling */
-    changedBits = newBits ^ oldBits_;
-    interruptMask = interruptMask | changedBits;
-    if (forceCallback_) interruptMask = 0xffffff;
-    if (interruptMask) {
-      oldBits_ = newBits;
-      forceCallback_ = 0;
-      asynPortDriver::setUIntDigitalParam(digitalInputParam_, newBits, 0xFFFFFFFF, interruptMask);
-      callParamCallbacks();
-    }
+ipUnidigGroup::ipUnidigGroup(const char *portName, IpUnidig **members, int numMembers, int msecPoll)
+  :asynPortDriver(portName,MAX_GROUP_MEMBERS,
+                  asynInt32Mask | asynFloat64Mask | asynUInt32DigitalMask |
+                  asynInt32ArrayMask | asynDrvUserMask,
+                  asynInt32Mask | asynFloat64Mask | asynUInt32DigitalMask |
+                  asynInt32ArrayMask,
+                  ASYN_MULTIDEVICE,1,0,0),
+  numMembers_(numMembers), havePublished_(0), sampleNs_(0), sampleMaxNs_(0)
+{
+  int i;
+
+  if (msecPoll == 0) msecPoll = 100;
+  pollTime_ = msecPoll / 1000.;
+  for (i=0; i<numMembers_; i++) {
+    members_[i] = members[i];
+    inputs_[i] = publishedInputs_[i] = 0;
+  }
+  wakeEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  createParam(groupInputsString,     asynParamInt32Array,    &groupInputsParam_);
+  createParam(groupInputString,      asynParamUInt32Digital, &groupInputParam_);
+  createParam(groupReadString,       asynParamInt32,         &groupReadParam_);
+  createParam(groupSampleTimeString, asynParamFloat64,       &groupSampleTimeParam_);
+  setDoubleParam(groupSampleTimeParam_, 0.);
+  epicsThreadCreate("ipUnidigGroup",
+                    epicsThreadPriorityHigh,
+                    epicsThreadGetStackSize(epicsThreadStackMedium),
+                    (EPICSTHREADFUNC)groupThreadC,
+                    this);
+}
+
+void ipUnidigGroup::sample()
+{
+  /* The time stamp is taken just before the critical section, which only
+   * contains the register reads */
+  epicsUInt32 bits[MAX_GROUP_MEMBERS];
+  epicsUInt64 start, end;
+  int key, i;
+
+  epicsTimeGetCurrent(&timeStamp_);
+  key = epicsInterruptLock();
+  start = epicsMonotonicGet();
+  for (i=0; i<numMembers_; i++) bits[i] = members_[i]->sampleInputs();
+  end = epicsMonotonicGet();
+  epicsInterruptUnlock(key);
+  for (i=0; i<numMembers_; i++) inputs_[i] = (epicsInt32)bits[i];
+  sampleNs_ = end - start;
+  if (sampleNs_ > sampleMaxNs_) sampleMaxNs_ = sampleNs_;
+}
+
+void ipUnidigGroup::publish()
+{
+  /* Does the callbacks for a sample that differs from the last one published */
+  epicsUInt32 changed;
+  int i;
+
+  setTimeStamp(&timeStamp_);
+  setDoubleParam(groupSampleTimeParam_, sampleNs_ / 1.e3);
+  for (i=0; i<numMembers_; i++) {
+    changed = havePublished_ ? (epicsUInt32)(inputs_[i] ^ publishedInputs_[i]) : 0xFFFFFFFF;
+    publishedInputs_[i] = inputs_[i];
+    setUIntDigitalParam(i, groupInputParam_, (epicsUInt32)inputs_[i], 0xFFFFFFFF, changed);
+    callParamCallbacks(i);
+  }
+  havePublished_ = 1;
+  doCallbacksInt32Array(publishedInputs_, numMembers_, groupInputsParam_, 0);
+}
+
+void ipUnidigGroup::groupThread()
+{
+  /* Samples the group every poll time, or when GROUP_READ is written, and
+   * publishes the samples that differ from the last one */
+  int i, changed;
+
+  while(1) {
+    epicsEventWaitWithTimeout(wakeEvent_, pollTime_);
+    lock();
+    sample();
+    changed = !havePublished_;
+    for (i=0; i<numMembers_; i++) {
+      if (inputs_[i] != publishedInputs_[i]) changed = 1;
+    }
+    if (changed) publish();
     unlock();
   }
 }
 
-
+asynStatus ipUnidigGroup::writeInt32(asynUser *pasynUser, epicsInt32 value)
+{
+  if (pasynUser->reason == groupReadParam_) {
+    epicsEventSignal(wakeEvent_);
+    return(asynSuccess);
+  }
+  return asynPortDriver::writeInt32(pasynUser, value);
+}
+
+asynStatus ipUnidigGroup::readInt32Array(asynUser *pasynUser, epicsInt32 *value, size_t nElements, size_t *nIn)
+{
+  static const char *functionName = "readInt32Array";
+  size_t n;
+
+  if (pasynUser->reason != groupInputsParam_) {
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s:%s:, invalid reason=%d\n", 
+              driverName, functionName, pasynUser->reason);
+    return(asynError);
+  }
+  /* Synchronous reads take a new sample, the thread publishes it if it changed */
+  sample();
+  n = (nElements < (size_t)numMembers_) ? nElements : numMembers_;
+  memcpy(value, inputs_, n * sizeof(epicsInt32));
+  *nIn = n;
+  pasynUser->timestamp = timeStamp_;
+  epicsEventSignal(wakeEvent_);
+  return(asynSuccess);
+}
+
+void ipUnidigGroup::report(FILE *fp, int details)
+{
+  int i;
+
+  fprintf(fp, "ipUnidigGroup %s: %d cards, poll time=%f s\n", this->portName, numMembers_, pollTime_);
+  if (details >= 1) {
+    for (i=0; i<numMembers_; i++) {
+      fprintf(fp, "  address %d: %s, inputs=%x\n", i, members_[i]->portName, inputs_[i]);
+    }
+    fprintf(fp, "  sample time=%f us, max=%f us\n", sampleNs_ / 1.e3, sampleMaxNs_ / 1.e3);
+  }
+  asynPortDriver::report(fp, details);
+}
+
+void IpUnidig::checkStorms(epicsUInt64 now, epicsUInt32 newBits, epicsUInt32 prevBits)
+{
+  /* Called by the poller for the bits in stormMask_.  Restarts the quiet
+   * time of the bits that changed, and enables the interrupts again for the
+   * bits that have been quiet long enough.  Bits that interrupt on both
+   * edges wait for the edge opposite to the current input. */
+  ipUnidigRegisters r = regs_;
+  epicsUInt32 quiet = 0, storms = stormMask_;
+  int i, key;
+
+  for (i=0; i<MAX_BITS; i++) {
+    if (!(storms & (1u << i))) continue;
+    if ((newBits ^ prevBits) & (1u << i)) stormChangeTime_[i] = now;
+    else if (now - stormChangeTime_[i] >= stormQuietNs_) quiet |= 1u << i;
+  }
+  if (quiet) {
+    key = epicsInterruptLock();
+    stormMask_ &= ~quiet;
+    quiet &= risingMask_ & fallingMask_;
+    polarityMask_ = (polarityMask_ & ~quiet) | (~newBits & quiet);
+    if (interruptsEnabled_) {
+      if (quiet && r.intPolarityRegisterLow) {
+        *r.intPolarityRegisterLow  = (epicsUInt16)polarityMask_;
+        *r.intPolarityRegisterHigh = (epicsUInt16)(polarityMask_ >> 16);
+      }
+      if (r.intEnableRegisterLow) writeIntEnableRegs();
+    }
+    epicsInterruptUnlock(key);
+  }
+  if (stormMask_ != stormPublishedMask_) {
+    for (i=0; i<MAX_BITS; i++) {
+      if (!((stormMask_ ^ stormPublishedMask_) & (1u << i))) continue;
+      setIntegerParam(i, stormActiveParam_, (stormMask_ >> i) & 1);
+      setIntegerParam(i, stormTripsParam_, (epicsInt32)stormTrips_[i]);
+      callParamCallbacks(i);
+    }
+    stormPublishedMask_ = stormMask_;
+    setIntegerParam(stormMaskParam_, stormMask_);
+  }
+}
+
+void IpUnidig::setInterruptMasks(epicsUInt32 rising, epicsUInt32 falling, epicsUInt32 polarity)
+{
+  /* Changes the interrupt masks with interrupts locked out, so intFunc()
+   * never sees the masks and the registers disagree.  Bits that interrupt on
+   * one edge wait for that edge.  Bits that interrupt on both edges keep the
+   * given polarity, except those that did not interrupt on both edges
+   * before, which wait for the opposite of the current input.  Called with
+   * the port lock held. */
+  ipUnidigRegisters r = regs_;
+  epicsUInt32 both = rising & falling;
+  epicsUInt32 newBoth = both & ~(risingMask_ & fallingMask_);
+  int key;
+
+  polarity = (polarity & ~newBoth) | (~oldBits_ & newBoth);
+  key = epicsInterruptLock();
+  risingMask_ = rising;
+  fallingMask_ = falling;
+  polarityMask_ = (rising & ~falling) | (polarity & both);
+  /* Only the masks are kept for modules without interrupts, and for cards
+   * started without an interrupt vector */
+  if (interruptsEnabled_) {
+    if (r.intPolarityRegisterLow) {
+      *r.intPolarityRegisterLow  = (epicsUInt16)polarityMask_;
+      *r.intPolarityRegisterHigh = (epicsUInt16)(polarityMask_ >> 16);
+    }
+    if (r.intEnableRegisterLow) writeIntEnableRegs();
+  }
+  epicsInterruptUnlock(key);
+  asynPortDriver::setUInt32DigitalInterrupt(digitalInputParam_, risingMask_, interruptOnZeroToOne);
+  asynPortDriver::setUInt32DigitalInterrupt(digitalInputParam_, fallingMask_, interruptOnOneToZero);
+  setIntegerParam(risingMaskParam_, risingMask_);
+  setIntegerParam(fallingMaskParam_, fallingMask_);
+  setIntegerParam(polarityParam_, polarityMask_);
+  callParamCallbacks();
+  /* The polled bits can have changed */
+  requestService();
+}
+
 void IpUnidig::writeIntEnableRegs()
 {
   ipUnidigRegisters r = regs_;
 
-  *r.intEnableRegisterLow  = (epicsUInt16) (risingMask_ | 
-                                            fallingMask_);
-  *r.intEnableRegisterHigh = (epicsUInt16) ((risingMask_ | 
-                                             fallingMask_) >> 16);
+  /* Bits with an interrupt storm are polled instead */
+  *r.intEnableRegisterLow  = (epicsUInt16) ((risingMask_ | 
+                                             fallingMask_) & ~stormMask_);
+  *r.intEnableRegisterHigh = (epicsUInt16) (((risingMask_ | 
+                                              fallingMask_) & ~stormMask_) >> 16);
 }
 
 void IpUnidig::rebootCallback()
@@ -703,9 +4093,14 @@ void IpUnidig::report(FILE *fp, int details)
 {
   ipUnidigRegisters r = regs_;
   epicsUInt32 intEnableRegister = 0, intPolarityRegister = 0;
+  int i;
 
-  fprintf(fp, "drvIpUnidig %s: connected at base address %p\n",
-          this->portName, baseAddress_);
+  fprintf(fp, "drvIpUnidig %s: %s card connected at base address %p\n",
+          this->portName, hardware_->name(), baseAddress_);
+  fprintf(fp, "  model=%s, inputs=%d, outputs=%d, interrupts=%s\n",
+          modelInfo_->name, modelInfo_->inputBits, modelInfo_->outputBits,
+          modelInfo_->supportsInterrupts ? "yes" : "no");
+  if (scheduler_) scheduler_->report(fp);
   if (details >= 1) {
     if (r.intEnableRegisterLow)    intEnableRegister =     *r.intEnableRegisterLow;
     if (r.intEnableRegisterHigh)   intEnableRegister |=   (*r.intEnableRegisterHigh << 16);
@@ -716,8 +4111,63 @@ void IpUnidig::report(FILE *fp, int details)
     fprintf(fp, "  fallingMask=%x\n", fallingMask_);
     fprintf(fp, "  intEnableRegister=%x\n", intEnableRegister);
     fprintf(fp, "  intPolarityRegister=%x\n", intPolarityRegister);
-    fprintf(fp, "  messages sent OK=%d; send failed (queue full)=%d\n",
-            messagesSent_, messagesFailed_);
+    if (r.intVecRegister) fprintf(fp, "  intVecRegister=%x\n", *r.intVecRegister & 0xff);
+    fprintf(fp, "  messages sent OK=%d; send failed (queue full)=%d; coalesced=%d\n",
+            messagesSent_, messagesFailed_, messagesCoalesced_);
+    fprintf(fp, "  coalescing=%s, ring depth=%d/%d\n",
+            coalesce_ ? "enabled" : "disabled", (int)ring_.depth(), RING_SIZE);
+    fprintf(fp, "  rate limited bits=%x, deferred bits=%x\n", rateLimitedMask_, deferredMask_);
+    fprintf(fp, "  output shadow=%x, output enable shadow=%x, output bus accesses saved=%d\n",
+            outputShadow_, outputEnableShadow_, outputAccessesSaved_);
+    fprintf(fp, "  transaction=%s, staged value=%x, staged mask=%x, output window=%g\n",
+            outputTransaction_ ? "open" : "closed", stagedValue_, stagedMask_, outputWindow_);
+    fprintf(fp, "  poll mask=%x, poll period=%f s, max=%f s, poll reads skipped=%d\n",
+            pollMask(), pollPeriod_, pollMaxPeriod_, pollReadsSkipped_);
+    fprintf(fp, "  service time mean=%f us, max=%f us over %d passes\n",
+            serviceCount_ ? serviceTimeSum_ / 1.e3 / serviceCount_ : 0.,
+            serviceTimeMax_ / 1.e3, serviceCount_);
+    fprintf(fp, "  sequencer state=%d, steps=%d, trigger mask=%x\n",
+            epicsAtomicGetIntT(&seqState_), seqPlaySteps_, seqTriggerMask_);
+    fprintf(fp, "  interrupts/s=%f, callbacks/s=%f, bus accesses/s=%f\n",
+            interruptRate_, callbackRate_, busAccessRate_);
+    fprintf(fp, "  queue depth=%d, high-water=%d\n", queueDepth_, queueHighWater_);
+    fprintf(fp, "  bit addressing=%s\n", bitAddressing_ ? "enabled" : "disabled");
+    fprintf(fp, "  debounced bits=%x, published inputs=%x\n", debounceMask_, publishedBits_);
+    fprintf(fp, "  interrupt storm bits=%x, quiet time=%g s\n", stormMask_, stormQuietNs_ / 1.e9);
+    if (log_) {
+      fprintf(fp, "  event log: %.0f records written, %s\n", (double)ipUnidigEventLogCount(log_),
+              ipUnidigEventLogFrozen(log_) ? "frozen" : "logging");
+    }
+    for (i=0; i<MAX_BITS; i++) {
+      if (!stormLimit_[i] && !stormTrips_[i]) continue;
+      fprintf(fp, "    bit %d: limit=%u per %g s, trips=%u%s\n", i, stormLimit_[i],
+              STORM_WINDOW / 1.e9, stormTrips_[i], (stormMask_ & (1u << i)) ? ", polled" : "");
+    }
+    fprintf(fp, "  input cache age=%g s, cache hits=%d\n", inputCacheAge_, cacheHits_);
+    for (i=0; i<numRules_; i++) {
+      fprintf(fp, "  rule %d: \"%s\", %s, %d terms, hits=%u, state=%d\n",
+              i, rules_[i].text, rules_[i].enabled ? "enabled" : "disabled",
+              rules_[i].numTerms, rules_[i].hits, rules_[i].lastResult);
+    }
+    fprintf(fp, "  capture state=%d, rate=%g Hz, samples=%d+%d, last capture=%d samples\n",
+            epicsAtomicGetIntT(&captureState_), captureRate_, capturePre_, capturePost_,
+            (int)captureNumSamples_);
+    for (i=0; i<MAX_BITS; i++) {
+      if (!pulses_[i].active) continue;
+      fprintf(fp, "  pulse output %d: width=%g s, period=%g s, remaining=%d, queued=%d, pulses=%u\n",
+              i, pulses_[i].width / 1.e9, pulses_[i].period / 1.e9,
+              pulses_[i].remaining, pulses_[i].queued, pulses_[i].numPulses);
+    }
+  }
+  if (details >= 2) {
+    fprintf(fp, "  interrupt to callback latency histogram:\n");
+    for (i=0; i<LATENCY_BUCKETS; i++) {
+      if (latencyHistogram_[i] == 0) continue;
+      if (i == LATENCY_BUCKETS-1)
+        fprintf(fp, "    >= %u us: %d\n", 1u << (i-1), latencyHistogram_[i]);
+      else
+        fprintf(fp, "    %u-%u us: %d\n", i ? 1u << (i-1) : 0, 1u << i, latencyHistogram_[i]);
+    }
   }
   asynPortDriver::report(fp, details);
 }
@@ -726,7 +4176,15 @@ extern "C" int initIpUnidig(const char *portName, int carrier, int slot,
                  int msecPoll, int intVec, int risingMask, 
                  int fallingMask)
 {
-  new IpUnidig(portName,carrier,slot,msecPoll,intVec,risingMask,fallingMask);
+  new IpUnidig(portName,new ipUnidigIpacHardware(carrier,slot),msecPoll,intVec,risingMask,fallingMask);
+  return(asynSuccess);
+}
+
+extern "C" int initIpUnidigSim(const char *portName, int model,
+                 int msecPoll, int intVec, int risingMask, 
+                 int fallingMask)
+{
+  new IpUnidig(portName,new ipUnidigSimHardware(portName,model),msecPoll,intVec,risingMask,fallingMask);
   return(asynSuccess);
 }
 
@@ -752,9 +4210,227 @@ static void initCallFunc(const iocshArgBuf *args)
                args[3].ival, args[4].ival, args[5].ival,
                args[6].ival);
 }
+
+static const iocshArg initSimArg0 = { "Port name",iocshArgString};
+static const iocshArg initSimArg1 = { "Model",iocshArgInt};
+static const iocshArg initSimArg2 = { "msecPoll",iocshArgInt};
+static const iocshArg initSimArg3 = { "intVec",iocshArgInt};
+static const iocshArg initSimArg4 = { "risingMask",iocshArgInt};
+static const iocshArg initSimArg5 = { "fallingMask",iocshArgInt};
+static const iocshArg * const initSimArgs[6] = {&initSimArg0,
+                                                &initSimArg1,
+                                                &initSimArg2,
+                                                &initSimArg3,
+                                                &initSimArg4,
+                                                &initSimArg5};
+static const iocshFuncDef initSimFuncDef = {"initIpUnidigSim",6,initSimArgs};
+static void initSimCallFunc(const iocshArgBuf *args)
+{
+  initIpUnidigSim(args[0].sval, args[1].ival, args[2].ival,
+                  args[3].ival, args[4].ival, args[5].ival);
+}
+
+extern "C" int ipUnidigSchedulerConfig(int numThreads, int priority)
+{
+  if (sharedScheduler) {
+    errlogPrintf("ipUnidigSchedulerConfig: the scheduler is already configured\n");
+    return(asynError);
+  }
+  if (numThreads <= 0) return(asynSuccess);
+  if (priority <= 0) priority = epicsThreadPriorityHigh;
+  sharedScheduler = new ipUnidigScheduler(numThreads, priority);
+  return(asynSuccess);
+}
+
+static const iocshArg schedulerArg0 = { "numThreads",iocshArgInt};
+static const iocshArg schedulerArg1 = { "priority",iocshArgInt};
+static const iocshArg * const schedulerArgs[2] = {&schedulerArg0,
+                                                  &schedulerArg1};
+static const iocshFuncDef schedulerFuncDef = {"ipUnidigSchedulerConfig",2,schedulerArgs};
+static void schedulerCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigSchedulerConfig(args[0].ival, args[1].ival);
+}
+
+static IpUnidig *findIpUnidig(const char *portName)
+{
+  return dynamic_cast<IpUnidig *>((asynPortDriver *)findAsynPortDriver(portName));
+}
+
+extern "C" int ipUnidigDebounce(const char *portName, int mask, double seconds)
+{
+  IpUnidig *pIpUnidig = findIpUnidig(portName);
+
+  if (!pIpUnidig) {
+    errlogPrintf("ipUnidigDebounce: %s is not an IP-Unidig port\n", portName);
+    return(asynError);
+  }
+  return pIpUnidig->setDebounce((epicsUInt32)mask, seconds);
+}
+
+static const iocshArg debounceArg0 = { "Port name",iocshArgString};
+static const iocshArg debounceArg1 = { "mask",iocshArgInt};
+static const iocshArg debounceArg2 = { "seconds",iocshArgDouble};
+static const iocshArg * const debounceArgs[3] = {&debounceArg0,
+                                                 &debounceArg1,
+                                                 &debounceArg2};
+static const iocshFuncDef debounceFuncDef = {"ipUnidigDebounce",3,debounceArgs};
+static void debounceCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigDebounce(args[0].sval, args[1].ival, args[2].dval);
+}
+
+extern "C" int ipUnidigCreateGroup(const char *portName, const char *memberPorts, int msecPoll)
+{
+  /* memberPorts is a list of IP-Unidig port names separated by spaces or
+   * commas.  The first is address 0 of the group port. */
+  IpUnidig *members[MAX_GROUP_MEMBERS];
+  char *names, *name, *last;
+  int numMembers = 0;
+
+  names = epicsStrDup(memberPorts);
+  for (name = epicsStrtok_r(names, " ,", &last); name; name = epicsStrtok_r(NULL, " ,", &last)) {
+    if (numMembers == MAX_GROUP_MEMBERS) {
+      errlogPrintf("ipUnidigCreateGroup: more than %d cards\n", MAX_GROUP_MEMBERS);
+      free(names);
+      return(asynError);
+    }
+    members[numMembers] = findIpUnidig(name);
+    if (!members[numMembers]) {
+      errlogPrintf("ipUnidigCreateGroup: %s is not an IP-Unidig port\n", name);
+      free(names);
+      return(asynError);
+    }
+    numMembers++;
+  }
+  free(names);
+  if (numMembers == 0) {
+    errlogPrintf("ipUnidigCreateGroup: no cards given\n");
+    return(asynError);
+  }
+  new ipUnidigGroup(portName, members, numMembers, msecPoll);
+  return(asynSuccess);
+}
+
+extern "C" int ipUnidigAddRule(const char *portName, const char *rule)
+{
+  IpUnidig *pIpUnidig = findIpUnidig(portName);
+
+  if (!pIpUnidig) {
+    errlogPrintf("ipUnidigAddRule: %s is not an IP-Unidig port\n", portName);
+    return(asynError);
+  }
+  return (pIpUnidig->addRule(rule) < 0) ? asynError : asynSuccess;
+}
+
+static const iocshArg ruleArg0 = { "Port name",iocshArgString};
+static const iocshArg ruleArg1 = { "Rule",iocshArgString};
+static const iocshArg * const ruleArgs[2] = {&ruleArg0,
+                                             &ruleArg1};
+static const iocshFuncDef ruleFuncDef = {"ipUnidigAddRule",2,ruleArgs};
+static void ruleCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigAddRule(args[0].sval, args[1].sval);
+}
+
+extern "C" int ipUnidigShmEnable(const char *portName, const char *name, int ringSize)
+{
+  IpUnidig *pIpUnidig = findIpUnidig(portName);
+
+  if (!pIpUnidig) {
+    errlogPrintf("ipUnidigShmEnable: %s is not an IP-Unidig port\n", portName);
+    return(asynError);
+  }
+  return (pIpUnidig->enableShm(name, ringSize) < 0) ? asynError : asynSuccess;
+}
+
+static const iocshArg shmArg0 = { "Port name",iocshArgString};
+static const iocshArg shmArg1 = { "Shared memory name",iocshArgString};
+static const iocshArg shmArg2 = { "Number of events",iocshArgInt};
+static const iocshArg * const shmArgs[3] = {&shmArg0,
+                                            &shmArg1,
+                                            &shmArg2};
+static const iocshFuncDef shmFuncDef = {"ipUnidigShmEnable",3,shmArgs};
+static void shmCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigShmEnable(args[0].sval, args[1].sval, args[2].ival);
+}
+
+extern "C" int ipUnidigLogEnable(const char *portName, const char *path, int numRecords)
+{
+  IpUnidig *pIpUnidig = findIpUnidig(portName);
+
+  if (!pIpUnidig) {
+    errlogPrintf("ipUnidigLogEnable: %s is not an IP-Unidig port\n", portName);
+    return(asynError);
+  }
+  return (pIpUnidig->enableLog(path, numRecords) < 0) ? asynError : asynSuccess;
+}
+
+extern "C" int ipUnidigLogFreeze(const char *portName, int postRecords)
+{
+  IpUnidig *pIpUnidig = findIpUnidig(portName);
+  int status;
+
+  if (!pIpUnidig) {
+    errlogPrintf("ipUnidigLogFreeze: %s is not an IP-Unidig port\n", portName);
+    return(asynError);
+  }
+  pIpUnidig->lock();
+  status = pIpUnidig->freezeLog(postRecords);
+  pIpUnidig->unlock();
+  if (status) {
+    errlogPrintf("ipUnidigLogFreeze: %s has no event log\n", portName);
+    return(asynError);
+  }
+  return(asynSuccess);
+}
+
+static const iocshArg logEnableArg0 = { "Port name",iocshArgString};
+static const iocshArg logEnableArg1 = { "File name",iocshArgString};
+static const iocshArg logEnableArg2 = { "Number of records",iocshArgInt};
+static const iocshArg * const logEnableArgs[3] = {&logEnableArg0,
+                                                  &logEnableArg1,
+                                                  &logEnableArg2};
+static const iocshFuncDef logEnableFuncDef = {"ipUnidigLogEnable",3,logEnableArgs};
+static void logEnableCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigLogEnable(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static const iocshArg logFreezeArg0 = { "Port name",iocshArgString};
+static const iocshArg logFreezeArg1 = { "Records after the trigger",iocshArgInt};
+static const iocshArg * const logFreezeArgs[2] = {&logFreezeArg0,
+                                                  &logFreezeArg1};
+static const iocshFuncDef logFreezeFuncDef = {"ipUnidigLogFreeze",2,logFreezeArgs};
+static void logFreezeCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigLogFreeze(args[0].sval, args[1].ival);
+}
+
+static const iocshArg groupArg0 = { "Port name",iocshArgString};
+static const iocshArg groupArg1 = { "Member ports",iocshArgString};
+static const iocshArg groupArg2 = { "msecPoll",iocshArgInt};
+static const iocshArg * const groupArgs[3] = {&groupArg0,
+                                              &groupArg1,
+                                              &groupArg2};
+static const iocshFuncDef groupFuncDef = {"ipUnidigCreateGroup",3,groupArgs};
+static void groupCallFunc(const iocshArgBuf *args)
+{
+  ipUnidigCreateGroup(args[0].sval, args[1].sval, args[2].ival);
+}
+
 void ipUnidigRegister(void)
 {
   iocshRegister(&initFuncDef,initCallFunc);
+  iocshRegister(&initSimFuncDef,initSimCallFunc);
+  iocshRegister(&schedulerFuncDef,schedulerCallFunc);
+  iocshRegister(&debounceFuncDef,debounceCallFunc);
+  iocshRegister(&groupFuncDef,groupCallFunc);
+  iocshRegister(&ruleFuncDef,ruleCallFunc);
+  iocshRegister(&shmFuncDef,shmCallFunc);
+  iocshRegister(&logEnableFuncDef,logEnableCallFunc);
+  iocshRegister(&logFreezeFuncDef,logFreezeCallFunc);
 }
 
 epicsExportRegistrar(ipUnidigRegister);
@@ -0,0 +1,300 @@
+/* ipUnidigBench.cpp
+
+    Benchmark of the IP-Unidig driver on a simulated card.
+
+    Edges are injected into a simulated card at a series of rates, and the
+    time from each injection to the asynUInt32Digital interrupt callbacks of
+    the registered clients is measured.  This covers intFunc(), the message
+    ring, the poller thread, setUIntDigitalParam and callParamCallbacks.
+
+    The inputs step through a Gray code, so every injection is a single edge,
+    and the callback value identifies the injection.  The poller makes one
+    callback for all the edges it drains at once, so each callback is paired
+    with every injection since the previous callback to that client, up to the
+    latest one with the callback value.  This is exact as long as fewer than
+    2^bits injections are in flight.  Injections that no callback delivered are
+    reported as unmatched.
+
+    The CPU time per event is that of the whole process, less the time the
+    injecting thread spends waiting for the next edge.
+
+    One JSON object is written to stdout for each rate, and a summary object
+    at the end, so results can be compared between releases.  Progress is
+    written to stderr.
+
+    usage: ipUnidigBench [-r startRate] [-R maxRate] [-f factor] [-t seconds]
+                         [-b bits] [-n clients] [-p msecPoll] [-c] [-k]
+      -r  First edge rate in Hz.  Default 1000.
+      -R  Last edge rate in Hz.  Default 1000000.
+      -f  Rate multiplier between steps.  Default 2.
+      -t  Duration of each step in seconds.  Default 2.
+      -b  Number of input bits that toggle, 1-16.  Default 8.
+      -n  Number of asynUInt32Digital clients.  Default 1.
+      -p  Driver poll time in msec.  Default 100.
+      -c  Leave interrupt coalescing enabled.  By default it is disabled, so
+          that ring overflows show up in MESSAGES_FAILED.
+      -k  Keep going after the first rate with failed messages.
+*/
+
+/* System includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <vector>
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+
+#include <asynDriver.h>
+#include <asynUInt32Digital.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define BENCH_PORT "BENCH"
+#define MAX_BENCH_BITS 16
+#define MAX_CLIENTS 64
+/* Limit on the latencies kept for the percentiles of one step */
+#define MAX_SAMPLES 4000000
+/* Time to let the poller drain after each step */
+#define DRAIN_TIME 0.5
+#define TIMEOUT 1.0
+
+typedef struct {
+  ipUnidigSimHardware *pSim;
+  epicsUInt64 *injectTimes;   /* Time of each injection, indexed by count */
+  int numInjected;            /* Published with epicsAtomic after injectTimes */
+  epicsUInt32 valueMask;
+  std::vector<epicsUInt32> *latencies;   /* ns */
+  epicsUInt32 numCallbacks;
+  epicsUInt32 delivered[MAX_CLIENTS];    /* Last injection delivered to each client */
+} benchState;
+
+typedef struct {
+  double rate;
+  epicsUInt32 injected;
+  epicsUInt32 callbacks;
+  epicsUInt32 unmatched;
+  int sent;
+  int failed;
+  int coalesced;
+  double p50, p90, p99, p999, max;
+  double cpuPerEvent;
+} benchResult;
+
+static benchState bench;
+
+static epicsUInt32 grayCode(epicsUInt32 count)
+{
+  return (count ^ (count >> 1)) & bench.valueMask;
+}
+
+static void benchCallback(void *userPvt, asynUser * /* pasynUser */, epicsUInt32 data)
+{
+  /* Called from the driver's poller thread, so there is only one writer */
+  epicsUInt64 now = epicsMonotonicGet();
+  epicsUInt32 *pDelivered = (epicsUInt32 *)userPvt;
+  epicsUInt32 injected, last, i;
+
+  injected = (epicsUInt32)epicsAtomicGetIntT(&bench.numInjected);
+  epicsAtomicReadMemoryBarrier();
+  bench.numCallbacks++;
+  /* Find the latest injection with this value, no more than 2^bits back */
+  for (last=injected; (last > *pDelivered) && (injected - last <= bench.valueMask); last--) {
+    if (grayCode(last) == (data & bench.valueMask)) break;
+  }
+  if ((last <= *pDelivered) || (injected - last > bench.valueMask)) return;
+  for (i=*pDelivered+1; i<=last; i++) {
+    if ((now >= bench.injectTimes[i]) && (bench.latencies->size() < MAX_SAMPLES))
+      bench.latencies->push_back((epicsUInt32)(now - bench.injectTimes[i]));
+  }
+  *pDelivered = last;
+}
+
+static double cpuSeconds()
+{
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1.e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1.e6;
+}
+
+static double threadCpuSeconds()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.e9;
+}
+
+static double percentile(const std::vector<epicsUInt32> &sorted, double fraction)
+{
+  size_t i;
+
+  if (sorted.empty()) return 0.;
+  i = (size_t)(fraction * (sorted.size() - 1));
+  return sorted[i] / 1.e3;
+}
+
+static int readCounter(const char *drvInfo)
+{
+  asynUser *pasynUser;
+  epicsInt32 value = 0;
+
+  if (pasynInt32SyncIO->connect(BENCH_PORT, 0, &pasynUser, drvInfo) != asynSuccess) return -1;
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void runStep(double rate, double duration, int clients, benchResult *result)
+{
+  epicsUInt64 start, due, now;
+  epicsUInt32 count, gray, total;
+  double cpuStart, waitStart, waitCpu = 0., delay;
+  int sent, failed, coalesced, i;
+
+  total = (epicsUInt32)(rate * duration);
+  /* The poller is idle between steps, so the arrays can be reset here */
+  free(bench.injectTimes);
+  bench.injectTimes = (epicsUInt64 *)calloc(total + 1, sizeof(epicsUInt64));
+  epicsAtomicSetIntT(&bench.numInjected, 0);
+  memset(bench.delivered, 0, sizeof(bench.delivered));
+  bench.latencies->clear();
+  bench.numCallbacks = 0;
+  sent = readCounter("MESSAGES_SENT");
+  failed = readCounter("MESSAGES_FAILED");
+  coalesced = readCounter("MESSAGES_COALESCED");
+  cpuStart = cpuSeconds();
+  start = epicsMonotonicGet();
+  for (count=1; count<=total; count++) {
+    /* Sleep while the next edge is more than a clock tick away, then spin.
+     * The CPU time of this wait is not the driver's, so it is subtracted. */
+    due = start + (epicsUInt64)(count / rate * 1.e9);
+    waitStart = threadCpuSeconds();
+    while ((now = epicsMonotonicGet()) < due) {
+      delay = (due - now) / 1.e9;
+      if (delay > 2. * epicsThreadSleepQuantum()) epicsThreadSleep(delay - epicsThreadSleepQuantum());
+    }
+    waitCpu += threadCpuSeconds() - waitStart;
+    gray = grayCode(count);
+    bench.injectTimes[count] = epicsMonotonicGet();
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetIntT(&bench.numInjected, (int)count);
+    bench.pSim->setInputs(gray, bench.valueMask);
+  }
+  epicsThreadSleep(DRAIN_TIME);
+  result->rate = rate;
+  result->injected = total;
+  result->cpuPerEvent = total ? (cpuSeconds() - cpuStart - waitCpu) / total * 1.e6 : 0.;
+  result->callbacks = bench.numCallbacks;
+  result->unmatched = 0;
+  for (i=0; i<clients; i++) result->unmatched += total - bench.delivered[i];
+  result->sent = readCounter("MESSAGES_SENT") - sent;
+  result->failed = readCounter("MESSAGES_FAILED") - failed;
+  result->coalesced = readCounter("MESSAGES_COALESCED") - coalesced;
+  std::sort(bench.latencies->begin(), bench.latencies->end());
+  result->p50  = percentile(*bench.latencies, 0.5);
+  result->p90  = percentile(*bench.latencies, 0.9);
+  result->p99  = percentile(*bench.latencies, 0.99);
+  result->p999 = percentile(*bench.latencies, 0.999);
+  result->max  = percentile(*bench.latencies, 1.0);
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: ipUnidigBench [-r startRate] [-R maxRate] [-f factor] [-t seconds]\n"
+                  "                     [-b bits] [-n clients] [-p msecPoll] [-c] [-k]\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  double startRate = 1000., maxRate = 1.e6, factor = 2., duration = 2.;
+  double rate, maxSustained = 0.;
+  int bits = 8, clients = 1, msecPoll = 100, coalesce = 0, keepGoing = 0;
+  int opt, i;
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
+  asynUInt32Digital *pasynUInt32Digital;
+  void *registrarPvt;
+  benchResult result;
+
+  while ((opt = getopt(argc, argv, "r:R:f:t:b:n:p:ck")) != -1) {
+    switch (opt) {
+      case 'r': startRate = atof(optarg); break;
+      case 'R': maxRate = atof(optarg); break;
+      case 'f': factor = atof(optarg); break;
+      case 't': duration = atof(optarg); break;
+      case 'b': bits = atoi(optarg); break;
+      case 'n': clients = atoi(optarg); break;
+      case 'p': msecPoll = atoi(optarg); break;
+      case 'c': coalesce = 1; break;
+      case 'k': keepGoing = 1; break;
+      default: usage();
+    }
+  }
+  if ((bits < 1) || (bits > MAX_BENCH_BITS) || (clients < 1) || (clients > MAX_CLIENTS) ||
+      (startRate <= 0.) || (factor <= 1.) || (duration <= 0.)) usage();
+
+  bench.valueMask = (1u << bits) - 1;
+  bench.latencies = new std::vector<epicsUInt32>;
+  bench.latencies->reserve(MAX_SAMPLES);
+
+  /* Interrupts on both edges of all the toggling bits */
+  initIpUnidigSim(BENCH_PORT, 0, msecPoll, 1, bench.valueMask, bench.valueMask);
+  bench.pSim = ipUnidigSimHardware::find(BENCH_PORT);
+  if (pasynInt32SyncIO->connect(BENCH_PORT, 0, &pasynUser, "COALESCE") == asynSuccess) {
+    pasynInt32SyncIO->write(pasynUser, coalesce, TIMEOUT);
+    pasynInt32SyncIO->disconnect(pasynUser);
+  }
+  /* Publish the message counters often, so each step sees its own counts */
+  if (pasynFloat64SyncIO->connect(BENCH_PORT, 0, &pasynUser, "STATS_PERIOD") == asynSuccess) {
+    pasynFloat64SyncIO->write(pasynUser, DRAIN_TIME / 5., TIMEOUT);
+    pasynFloat64SyncIO->disconnect(pasynUser);
+  }
+  for (i=0; i<clients; i++) {
+    if (pasynUInt32DigitalSyncIO->connect(BENCH_PORT, 0, &pasynUser, "DIGITAL_INPUT") != asynSuccess) {
+      fprintf(stderr, "ipUnidigBench: cannot connect to %s\n", BENCH_PORT);
+      return 1;
+    }
+    pasynInterface = pasynManager->findInterface(pasynUser, asynUInt32DigitalType, 1);
+    pasynUInt32Digital = (asynUInt32Digital *)pasynInterface->pinterface;
+    pasynUInt32Digital->registerInterruptUser(pasynInterface->drvPvt, pasynUser,
+                                              benchCallback, &bench.delivered[i], bench.valueMask,
+                                              &registrarPvt);
+  }
+
+  for (rate=startRate; rate<=maxRate; rate*=factor) {
+    fprintf(stderr, "ipUnidigBench: %g Hz\n", rate);
+    runStep(rate, duration, clients, &result);
+    printf("{\"rate\": %g, \"bits\": %d, \"clients\": %d, \"coalesce\": %d, "
+           "\"injected\": %u, \"callbacks\": %u, \"unmatched\": %u, \"messages_sent\": %d, "
+           "\"messages_failed\": %d, \"messages_coalesced\": %d, "
+           "\"latency_p50_us\": %.3f, \"latency_p90_us\": %.3f, \"latency_p99_us\": %.3f, "
+           "\"latency_p999_us\": %.3f, \"latency_max_us\": %.3f, \"cpu_us_per_event\": %.3f}\n",
+           result.rate, bits, clients, coalesce, result.injected, result.callbacks,
+           result.unmatched,            result.sent, result.failed, result.coalesced,
+           result.p50, result.p90, result.p99, result.p999, result.max, result.cpuPerEvent);
+    fflush(stdout);
+    if (result.failed == 0) {
+      maxSustained = rate;
+    } else if (!keepGoing) {
+      break;
+    }
+  }
+  printf("{\"summary\": true, \"bits\": %d, \"clients\": %d, \"coalesce\": %d, "
+         "\"max_sustainable_rate\": %g}\n",
+         bits, clients, coalesce, maxSustained);
+  return 0;
+}
@@ -0,0 +1,142 @@
+/* ipUnidigCountTest.cpp
+
+    Regression test of the per-bit edge counters (RISING_COUNT,
+    FALLING_COUNT), their latching and reset, on a simulated card.
+
+    Edges on interrupting bits are counted in the interrupt routine, so a
+    burst faster than the poller must still be counted exactly.  Edges on
+    polled bits must be counted when they are slower than the poll time.
+*/
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define TEST_PORT "COUNT"
+#define TIMEOUT 1.0
+#define BURST_BIT   0x1     /* Interrupts on both edges */
+#define RISING_BIT  0x2     /* Interrupts on the rising edge only */
+#define TRIGGER_BIT 0x4     /* Interrupts on the rising edge, latches the counters */
+#define POLLED_BIT  0x10    /* No interrupts */
+#define MSEC_POLL   20
+/* Longer than a STATS_PERIOD, so the counters have been published */
+#define SETTLE_TIME 0.2
+
+static epicsInt32 readInt32(const char *drvInfo, int addr)
+{
+  asynUser *pasynUser;
+  epicsInt32 value = -1;
+
+  pasynInt32SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeInt32(const char *drvInfo, int addr, epicsInt32 value)
+{
+  asynUser *pasynUser;
+
+  pasynInt32SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynInt32SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+}
+
+static void writeFloat64(const char *drvInfo, int addr, epicsFloat64 value)
+{
+  asynUser *pasynUser;
+
+  pasynFloat64SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynFloat64SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+}
+
+static void pulse(ipUnidigSimHardware *pSim, epicsUInt32 bit, int count, double halfPeriod)
+{
+  int i;
+
+  for (i=0; i<count; i++) {
+    pSim->setInputs(bit, bit);
+    if (halfPeriod > 0.) epicsThreadSleep(halfPeriod);
+    pSim->setInputs(0, bit);
+    if (halfPeriod > 0.) epicsThreadSleep(halfPeriod);
+  }
+}
+
+MAIN(ipUnidigCountTest)
+{
+  ipUnidigSimHardware *pSim;
+  int rising, falling;
+
+  testPlan(13);
+  initIpUnidigSim(TEST_PORT, 0, MSEC_POLL, 1, BURST_BIT | RISING_BIT | TRIGGER_BIT, BURST_BIT);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  writeFloat64("STATS_PERIOD", 0, 0.05);
+  epicsThreadSleep(SETTLE_TIME);
+
+  /* A burst much faster than the poller on an interrupting bit */
+  pulse(pSim, BURST_BIT, 500, 0.);
+  epicsThreadSleep(SETTLE_TIME);
+  rising = readInt32("RISING_COUNT", 0);
+  falling = readInt32("FALLING_COUNT", 0);
+  testOk((rising == 500) && (falling == 500), "burst counted exactly, rising=%d falling=%d",
+         rising, falling);
+
+  /* Rising edges interrupt, the falling edges are seen by the poller */
+  pulse(pSim, RISING_BIT, 10, 3 * MSEC_POLL / 1000.);
+  epicsThreadSleep(SETTLE_TIME);
+  rising = readInt32("RISING_COUNT", 1);
+  falling = readInt32("FALLING_COUNT", 1);
+  testOk((rising == 10) && (falling == 10), "rising interrupt bit, rising=%d falling=%d",
+         rising, falling);
+
+  /* Edges slower than the poll time on a bit with no interrupts */
+  pulse(pSim, POLLED_BIT, 5, 3 * MSEC_POLL / 1000.);
+  epicsThreadSleep(SETTLE_TIME);
+  rising = readInt32("RISING_COUNT", 4);
+  falling = readInt32("FALLING_COUNT", 4);
+  testOk((rising == 5) && (falling == 5), "polled bit, rising=%d falling=%d", rising, falling);
+  testOk(readInt32("RISING_COUNT", 3) == 0, "quiet bit not counted");
+
+  /* COUNT_LATCH copies all the counters */
+  writeInt32("COUNT_LATCH", 0, 1);
+  testOk(readInt32("RISING_LATCHED", 0) == 500, "COUNT_LATCH latched bit 0, %d",
+         readInt32("RISING_LATCHED", 0));
+  testOk(readInt32("FALLING_LATCHED", 4) == 5, "COUNT_LATCH latched bit 4, %d",
+         readInt32("FALLING_LATCHED", 4));
+
+  /* An edge on a bit in COUNT_LATCH_MASK latches in the interrupt routine */
+  writeInt32("COUNT_LATCH_MASK", 0, TRIGGER_BIT);
+  pulse(pSim, BURST_BIT, 7, 0.);
+  pSim->setInputs(TRIGGER_BIT, TRIGGER_BIT);
+  pulse(pSim, BURST_BIT, 3, 0.);
+  epicsThreadSleep(SETTLE_TIME);
+  testOk(readInt32("RISING_LATCHED", 0) == 507, "trigger edge latched bit 0 at %d",
+         readInt32("RISING_LATCHED", 0));
+  testOk(readInt32("RISING_LATCHED", 2) == 1, "latch includes the triggering edge");
+  testOk(readInt32("RISING_COUNT", 0) == 510, "counting continues after the latch, %d",
+         readInt32("RISING_COUNT", 0));
+  pSim->setInputs(0, TRIGGER_BIT);
+
+  /* COUNT_RESET only resets the bits in its mask */
+  writeInt32("COUNT_RESET", 0, BURST_BIT);
+  epicsThreadSleep(SETTLE_TIME);
+  testOk((readInt32("RISING_COUNT", 0) == 0) && (readInt32("FALLING_COUNT", 0) == 0),
+         "COUNT_RESET clears bit 0");
+  testOk(readInt32("RISING_COUNT", 4) == 5, "COUNT_RESET leaves bit 4");
+  pulse(pSim, BURST_BIT, 2, 0.);
+  epicsThreadSleep(SETTLE_TIME);
+  testOk(readInt32("RISING_COUNT", 0) == 2, "counting restarts from 0, %d",
+         readInt32("RISING_COUNT", 0));
+  testOk(readInt32("RISING_LATCHED", 0) == 0, "COUNT_RESET clears the latched value");
+
+  return testDone();
+}
@@ -0,0 +1,165 @@
+/* ipUnidigDebounceTest.cpp
+
+    Regression test of the per-bit debounce filter (DEBOUNCE_TIME,
+    GLITCH_COUNT), on a simulated card.
+
+    A debounced input must only be published once it has held its new state
+    for the debounce time, measured from its last edge, both for an input
+    that interrupts and for one that is polled.  Bounces that end at the
+    published state must give no callback and be counted as glitches.  An
+    input that is not debounced must not be delayed.
+*/
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsAtomic.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynUInt32Digital.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define TEST_PORT "DEBOUNCE"
+#define TIMEOUT 1.0
+#define INT_BIT    0x1     /* Interrupts on both edges, debounced */
+#define PLAIN_BIT  0x2     /* Interrupts on both edges, not debounced */
+#define POLLED_BIT 0x10    /* No interrupts, debounced */
+#define MSEC_POLL 20
+#define DEBOUNCE_TIME 0.1
+
+typedef struct {
+  int numCallbacks;
+  epicsUInt32 lastValue;
+  epicsUInt64 lastTime;
+} testClient;
+
+static testClient intClient, plainClient, polledClient;
+
+static void testCallback(void *userPvt, asynUser * /* pasynUser */, epicsUInt32 data)
+{
+  testClient *pClient = (testClient *)userPvt;
+
+  pClient->lastTime = epicsMonotonicGet();
+  pClient->lastValue = data;
+  epicsAtomicIncrIntT(&pClient->numCallbacks);
+}
+
+static void registerClient(epicsUInt32 mask, testClient *pClient)
+{
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
+  asynUInt32Digital *pasynUInt32Digital;
+  void *registrarPvt;
+
+  pasynUInt32DigitalSyncIO->connect(TEST_PORT, 0, &pasynUser, "DIGITAL_INPUT");
+  pasynInterface = pasynManager->findInterface(pasynUser, asynUInt32DigitalType, 1);
+  pasynUInt32Digital = (asynUInt32Digital *)pasynInterface->pinterface;
+  pasynUInt32Digital->registerInterruptUser(pasynInterface->drvPvt, pasynUser, testCallback,
+                                            pClient, mask, &registrarPvt);
+}
+
+static epicsInt32 readInt32(const char *drvInfo, int addr)
+{
+  asynUser *pasynUser;
+  epicsInt32 value = -1;
+
+  pasynInt32SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeFloat64(const char *drvInfo, int addr, epicsFloat64 value)
+{
+  asynUser *pasynUser;
+
+  pasynFloat64SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynFloat64SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+}
+
+static epicsUInt64 bounce(ipUnidigSimHardware *pSim, epicsUInt32 bit, int numEdges, int endHigh)
+{
+  /* Makes numEdges edges 5 ms apart, the last one to endHigh, and returns
+   * the time of the last edge */
+  int i;
+
+  for (i=numEdges-1; i>=0; i--) {
+    pSim->setInputs(((i & 1) ^ endHigh) ? bit : 0, bit);
+    if (i > 0) epicsThreadSleep(0.005);
+  }
+  return epicsMonotonicGet();
+}
+
+MAIN(ipUnidigDebounceTest)
+{
+  ipUnidigSimHardware *pSim;
+  epicsUInt64 edgeTime;
+  double delay;
+  int callbacks;
+
+  testPlan(12);
+  initIpUnidigSim(TEST_PORT, 0, MSEC_POLL, 1, INT_BIT | PLAIN_BIT, INT_BIT | PLAIN_BIT);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  writeFloat64("STATS_PERIOD", 0, 0.05);
+  writeFloat64("DEBOUNCE_TIME", 0, DEBOUNCE_TIME);
+  writeFloat64("DEBOUNCE_TIME", 4, DEBOUNCE_TIME);
+  registerClient(INT_BIT, &intClient);
+  registerClient(PLAIN_BIT, &plainClient);
+  registerClient(POLLED_BIT, &polledClient);
+  epicsThreadSleep(0.2);
+
+  /* Hold: a clean edge is published one debounce time later */
+  edgeTime = bounce(pSim, INT_BIT, 1, 1);
+  epicsThreadSleep(DEBOUNCE_TIME / 2);
+  testOk(epicsAtomicGetIntT(&intClient.numCallbacks) == 0, "no callback before the debounce time");
+  epicsThreadSleep(DEBOUNCE_TIME);
+  delay = (intClient.lastTime - edgeTime) / 1.e9;
+  testOk((epicsAtomicGetIntT(&intClient.numCallbacks) == 1) && (intClient.lastValue == INT_BIT),
+         "held edge published, value=%x", intClient.lastValue);
+  testOk(delay >= DEBOUNCE_TIME, "published %f s after the edge", delay);
+
+  /* Bounces that end at the published state are glitches */
+  bounce(pSim, INT_BIT, 6, 1);
+  epicsThreadSleep(2 * DEBOUNCE_TIME);
+  testOk(epicsAtomicGetIntT(&intClient.numCallbacks) == 1, "bounce back to high gives no callback");
+  testOk(readInt32("GLITCH_COUNT", 0) == 3, "3 returns to high counted as glitches, %d",
+         readInt32("GLITCH_COUNT", 0));
+
+  /* Release: bounces ending low are published once, after the last edge */
+  edgeTime = bounce(pSim, INT_BIT, 7, 0);
+  epicsThreadSleep(2 * DEBOUNCE_TIME);
+  callbacks = epicsAtomicGetIntT(&intClient.numCallbacks);
+  delay = (intClient.lastTime - edgeTime) / 1.e9;
+  testOk((callbacks == 2) && (intClient.lastValue == 0), "release published once, %d callbacks",
+         callbacks);
+  testOk(delay >= DEBOUNCE_TIME, "published %f s after the last edge", delay);
+
+  /* A polled input is debounced too */
+  edgeTime = bounce(pSim, POLLED_BIT, 1, 1);
+  epicsThreadSleep(DEBOUNCE_TIME / 2);
+  testOk(epicsAtomicGetIntT(&polledClient.numCallbacks) == 0,
+         "no polled callback before the debounce time");
+  epicsThreadSleep(DEBOUNCE_TIME + 2 * MSEC_POLL / 1000.);
+  delay = (polledClient.lastTime - edgeTime) / 1.e9;
+  testOk((epicsAtomicGetIntT(&polledClient.numCallbacks) == 1) && (polledClient.lastValue == POLLED_BIT),
+         "held polled input published, value=%x", polledClient.lastValue);
+  testOk(delay >= DEBOUNCE_TIME, "polled input published %f s after the edge", delay);
+
+  /* An input that is not debounced is not delayed */
+  edgeTime = bounce(pSim, PLAIN_BIT, 1, 1);
+  epicsThreadSleep(DEBOUNCE_TIME / 2);
+  testOk((epicsAtomicGetIntT(&plainClient.numCallbacks) == 1) && (plainClient.lastValue == PLAIN_BIT),
+         "plain input published at once");
+  delay = (plainClient.lastTime - edgeTime) / 1.e9;
+  testOk(delay < DEBOUNCE_TIME / 2, "plain input published %f s after the edge", delay);
+
+  return testDone();
+}
@@ -0,0 +1,187 @@
+/* ipUnidigEventLog.c
+
+    Memory mapped binary event log.  See ipUnidigEventLog.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ipUnidigEventLog.h"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct ipUnidigEventLog {
+  void *base;
+  size_t size;
+  ipUnidigLogHeader *pHeader;
+  ipUnidigLogRecord *pRecords;
+  int freezing;
+  uint32_t postRecords;
+};
+
+/* The records start on their own cache line */
+#define LOG_HEADER_SIZE 64
+
+ipUnidigEventLog *ipUnidigEventLogOpen(const char *path, const char *portName, uint32_t numRecords)
+{
+  ipUnidigEventLog *pLog;
+  ipUnidigLogHeader header;
+  struct stat st;
+  size_t size;
+  void *base;
+  int fd, reuse = 0;
+
+  if (numRecords == 0) return NULL;
+  size = LOG_HEADER_SIZE + (size_t)numRecords * sizeof(ipUnidigLogRecord);
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    perror("ipUnidigEventLogOpen: open");
+    return NULL;
+  }
+  if ((fstat(fd, &st) == 0) && ((size_t)st.st_size == size) &&
+      (read(fd, &header, sizeof(header)) == sizeof(header)) &&
+      (header.magic == IP_UNIDIG_LOG_MAGIC) && (header.version == IP_UNIDIG_LOG_VERSION) &&
+      (header.recordSize == sizeof(ipUnidigLogRecord)) && (header.numRecords == numRecords)) {
+    reuse = 1;
+  } else if ((ftruncate(fd, 0) != 0) || (posix_fallocate(fd, 0, size) != 0)) {
+    /* Allocate the blocks now, so a full disk is found here and not by a
+     * SIGBUS in the poller */
+    perror("ipUnidigEventLogOpen: cannot allocate the log");
+    close(fd);
+    return NULL;
+  }
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("ipUnidigEventLogOpen: mmap");
+    return NULL;
+  }
+  pLog = (ipUnidigEventLog *)calloc(1, sizeof(ipUnidigEventLog));
+  if (!pLog) {
+    munmap(base, size);
+    return NULL;
+  }
+  pLog->base = base;
+  pLog->size = size;
+  pLog->pHeader = (ipUnidigLogHeader *)base;
+  pLog->pRecords = (ipUnidigLogRecord *)((char *)base + LOG_HEADER_SIZE);
+  /* A log that was frozen before a reboot stays frozen until it is resumed */
+  if (!reuse) {
+    pLog->pHeader->magic = IP_UNIDIG_LOG_MAGIC;
+    pLog->pHeader->version = IP_UNIDIG_LOG_VERSION;
+    pLog->pHeader->recordSize = sizeof(ipUnidigLogRecord);
+    pLog->pHeader->numRecords = numRecords;
+    pLog->pHeader->count = 0;
+    pLog->pHeader->frozen = 0;
+  }
+  strncpy(pLog->pHeader->portName, portName, sizeof(pLog->pHeader->portName) - 1);
+  return pLog;
+}
+
+void ipUnidigEventLogWrite(ipUnidigEventLog *pLog, uint32_t sec, uint32_t nsec, uint32_t inputs,
+                           uint32_t interruptMask, uint32_t risingMask, uint32_t outputs)
+{
+  ipUnidigLogHeader *pHeader = pLog->pHeader;
+  ipUnidigLogRecord *pRecord;
+
+  if (pHeader->frozen) return;
+  pRecord = &pLog->pRecords[pHeader->count % pHeader->numRecords];
+  pRecord->sec = sec;
+  pRecord->nsec = nsec;
+  pRecord->inputs = inputs;
+  pRecord->interruptMask = interruptMask;
+  pRecord->risingMask = risingMask;
+  pRecord->outputs = outputs;
+  pRecord->seq = ++pHeader->count;
+  if (pLog->freezing && (pLog->postRecords-- == 0)) {
+    pLog->freezing = 0;
+    pHeader->frozen = 1;
+    /* Start the write-back now, without waiting for it */
+    msync(pLog->base, pLog->size, MS_ASYNC);
+  }
+}
+
+void ipUnidigEventLogFreeze(ipUnidigEventLog *pLog, uint32_t postRecords)
+{
+  if (postRecords == 0) {
+    pLog->pHeader->frozen = 1;
+    msync(pLog->base, pLog->size, MS_ASYNC);
+    return;
+  }
+  pLog->postRecords = postRecords - 1;
+  pLog->freezing = 1;
+}
+
+void ipUnidigEventLogResume(ipUnidigEventLog *pLog)
+{
+  pLog->freezing = 0;
+  pLog->pHeader->frozen = 0;
+}
+
+int ipUnidigEventLogFrozen(ipUnidigEventLog *pLog)
+{
+  return pLog->pHeader->frozen != 0;
+}
+
+uint64_t ipUnidigEventLogCount(ipUnidigEventLog *pLog)
+{
+  return pLog->pHeader->count;
+}
+
+void ipUnidigEventLogClose(ipUnidigEventLog *pLog)
+{
+  if (!pLog) return;
+  msync(pLog->base, pLog->size, MS_SYNC);
+  munmap(pLog->base, pLog->size);
+  free(pLog);
+}
+
+#else /* __linux__ */
+
+ipUnidigEventLog *ipUnidigEventLogOpen(const char *path, const char *portName, uint32_t numRecords)
+{
+  (void)path; (void)portName; (void)numRecords;
+  fprintf(stderr, "ipUnidigEventLogOpen: the event log is only supported on Linux\n");
+  return NULL;
+}
+
+void ipUnidigEventLogWrite(ipUnidigEventLog *pLog, uint32_t sec, uint32_t nsec, uint32_t inputs,
+                           uint32_t interruptMask, uint32_t risingMask, uint32_t outputs)
+{
+  (void)pLog; (void)sec; (void)nsec; (void)inputs; (void)interruptMask; (void)risingMask; (void)outputs;
+}
+
+void ipUnidigEventLogFreeze(ipUnidigEventLog *pLog, uint32_t postRecords)
+{
+  (void)pLog; (void)postRecords;
+}
+
+void ipUnidigEventLogResume(ipUnidigEventLog *pLog)
+{
+  (void)pLog;
+}
+
+int ipUnidigEventLogFrozen(ipUnidigEventLog *pLog)
+{
+  (void)pLog;
+  return 0;
+}
+
+uint64_t ipUnidigEventLogCount(ipUnidigEventLog *pLog)
+{
+  (void)pLog;
+  return 0;
+}
+
+void ipUnidigEventLogClose(ipUnidigEventLog *pLog)
+{
+  (void)pLog;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,69 @@
+/* ipUnidigEventLog.h
+
+    Binary event log of the IP-Unidig inputs, for post-mortem analysis.
+
+    The log is a preallocated file that is memory mapped and written as a
+    circular buffer of fixed size records, so appending a record never
+    waits for the disk.  The kernel writes the pages back in the background,
+    and they survive a crash of the IOC process.  Freezing the log stops the
+    appends, optionally after a number of further records, so the edges that
+    led up to a trip are kept.  ipUnidigLogDump converts a log to text.
+
+    This is only implemented on Linux.  On other systems
+    ipUnidigEventLogOpen returns NULL.
+*/
+
+#ifndef IP_UNIDIG_EVENT_LOG_H
+#define IP_UNIDIG_EVENT_LOG_H
+
+#include <stdint.h>
+
+#define IP_UNIDIG_LOG_MAGIC   0x4950554c  /* "IPUL" */
+#define IP_UNIDIG_LOG_VERSION 1
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t numRecords;
+  uint64_t count;             /* Number of records written */
+  uint32_t frozen;
+  uint32_t pad;
+  char portName[32];
+} ipUnidigLogHeader;
+
+/* Times are POSIX seconds and nanoseconds.  Record i of the log is at
+ * index i % numRecords, and its seq is i + 1. */
+typedef struct {
+  uint64_t seq;
+  uint32_t sec;
+  uint32_t nsec;
+  uint32_t inputs;
+  uint32_t interruptMask;     /* 0 for changes seen by polling */
+  uint32_t risingMask;
+  uint32_t outputs;
+} ipUnidigLogRecord;
+
+typedef struct ipUnidigEventLog ipUnidigEventLog;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Opens the log, creating or resizing the file as needed.  An existing log
+ * of the same size is appended to, unless it was frozen. */
+ipUnidigEventLog *ipUnidigEventLogOpen(const char *path, const char *portName, uint32_t numRecords);
+void ipUnidigEventLogWrite(ipUnidigEventLog *pLog, uint32_t sec, uint32_t nsec, uint32_t inputs,
+                           uint32_t interruptMask, uint32_t risingMask, uint32_t outputs);
+/* Freezes the log after postRecords more records */
+void ipUnidigEventLogFreeze(ipUnidigEventLog *pLog, uint32_t postRecords);
+void ipUnidigEventLogResume(ipUnidigEventLog *pLog);
+int ipUnidigEventLogFrozen(ipUnidigEventLog *pLog);
+uint64_t ipUnidigEventLogCount(ipUnidigEventLog *pLog);
+void ipUnidigEventLogClose(ipUnidigEventLog *pLog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IP_UNIDIG_EVENT_LOG_H */
@@ -0,0 +1,107 @@
+/* ipUnidigFrequencyTest.cpp
+
+    Regression test of the per-bit FREQUENCY, PERIOD and DUTY_CYCLE
+    measurements, on a simulated card.
+
+    A square wave from the simulator's generator, a slower waveform with a
+    known duty cycle, a bit held high and a bit held low are measured over
+    several gates.  The times come from thread sleeps, so the limits allow
+    for scheduling jitter.
+*/
+
+/* System includes */
+#include <math.h>
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynFloat64SyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define TEST_PORT "FREQ"
+#define TIMEOUT 1.0
+#define SQUARE_BIT 0x1     /* Generator, 100 Hz */
+#define HIGH_BIT   0x2     /* Held high */
+#define LOW_BIT    0x4     /* Held low */
+#define DUTY_BIT   0x8     /* 30 ms high, 10 ms low */
+#define GATE_TIME  0.5
+
+static epicsFloat64 readFloat64(const char *drvInfo, int addr)
+{
+  asynUser *pasynUser;
+  epicsFloat64 value = -1.;
+
+  pasynFloat64SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynFloat64SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeFloat64(const char *drvInfo, int addr, epicsFloat64 value)
+{
+  asynUser *pasynUser;
+
+  pasynFloat64SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynFloat64SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+}
+
+static int near(double value, double expected, double fraction)
+{
+  return fabs(value - expected) <= fraction * expected;
+}
+
+MAIN(ipUnidigFrequencyTest)
+{
+  ipUnidigSimHardware *pSim;
+  double frequency, period, duty;
+  int i;
+
+  testPlan(9);
+  /* Interrupts on both edges of all the test bits */
+  initIpUnidigSim(TEST_PORT, 0, 20, 1, 0xf, 0xf);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  writeFloat64("GATE_TIME", 0, GATE_TIME);
+  pSim->setInputs(HIGH_BIT, HIGH_BIT | LOW_BIT);
+
+  /* The generator makes 200 changes a second, a 100 Hz square wave */
+  pSim->startGenerator(SQUARE_BIT, 200.);
+  for (i=0; i<(int)(3 * GATE_TIME / 0.04); i++) {
+    pSim->setInputs(DUTY_BIT, DUTY_BIT);
+    epicsThreadSleep(0.03);
+    pSim->setInputs(0, DUTY_BIT);
+    epicsThreadSleep(0.01);
+  }
+  pSim->startGenerator(SQUARE_BIT, 0.);
+
+  frequency = readFloat64("FREQUENCY", 0);
+  period = readFloat64("PERIOD", 0);
+  duty = readFloat64("DUTY_CYCLE", 0);
+  testOk(near(frequency, 100., 0.1), "square wave FREQUENCY=%f", frequency);
+  testOk(near(period, 0.01, 0.1), "square wave PERIOD=%f", period);
+  testOk(near(duty, 50., 0.2), "square wave DUTY_CYCLE=%f", duty);
+
+  /* Sleeps only get longer, so the waveform can only be slower */
+  frequency = readFloat64("FREQUENCY", 3);
+  duty = readFloat64("DUTY_CYCLE", 3);
+  testOk((frequency > 15.) && (frequency <= 26.), "30/10 ms waveform FREQUENCY=%f", frequency);
+  testOk(near(duty, 75., 0.15), "30/10 ms waveform DUTY_CYCLE=%f", duty);
+
+  /* A bit that went high before the gate and stayed high */
+  testOk(readFloat64("DUTY_CYCLE", 1) > 99., "high bit DUTY_CYCLE=%f", readFloat64("DUTY_CYCLE", 1));
+  testOk((readFloat64("FREQUENCY", 1) == 0.) && (readFloat64("PERIOD", 1) == 0.),
+         "high bit has FREQUENCY=0 and PERIOD=0");
+  testOk(readFloat64("DUTY_CYCLE", 2) == 0., "low bit DUTY_CYCLE=%f", readFloat64("DUTY_CYCLE", 2));
+
+  /* After the inputs stop, a whole gate with no edges reads 0 */
+  epicsThreadSleep(2.5 * GATE_TIME);
+  testOk(readFloat64("FREQUENCY", 0) == 0., "stopped square wave FREQUENCY=%f",
+         readFloat64("FREQUENCY", 0));
+
+  return testDone();
+}
@@ -0,0 +1,154 @@
+/* ipUnidigGroupTest.cpp
+
+    Regression test of card groups (ipUnidigCreateGroup), over three
+    simulated cards.
+
+    A group sample must latch all the cards together.  A thread keeps
+    setting all the cards to the same count with interrupts locked out, as
+    a real coincidence would appear on the bus, and no sample may ever see
+    the cards disagree.  GROUP_READ must take a sample at once, and
+    GROUP_INPUT callbacks must only be done for the cards that changed.
+*/
+
+/* System includes */
+#include <stdio.h>
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsInterrupt.h>
+#include <epicsAtomic.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynUInt32Digital.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+#include <asynInt32ArraySyncIO.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+extern "C" int ipUnidigCreateGroup(const char *portName, const char *memberPorts, int msecPoll);
+
+#define GROUP_PORT "GROUP"
+#define NUM_CARDS 3
+#define NUM_WRITES 200000
+#define TIMEOUT 1.0
+
+typedef struct {
+  int numCallbacks;
+  epicsUInt32 lastValue;
+} testClient;
+
+static ipUnidigSimHardware *sims[NUM_CARDS];
+static testClient clients[NUM_CARDS];
+static int numWrites;
+
+static void testCallback(void *userPvt, asynUser * /* pasynUser */, epicsUInt32 data)
+{
+  testClient *pClient = (testClient *)userPvt;
+
+  pClient->lastValue = data;
+  epicsAtomicIncrIntT(&pClient->numCallbacks);
+}
+
+static void registerClient(int addr, testClient *pClient)
+{
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
+  asynUInt32Digital *pasynUInt32Digital;
+  void *registrarPvt;
+
+  pasynUInt32DigitalSyncIO->connect(GROUP_PORT, addr, &pasynUser, "GROUP_INPUT");
+  pasynInterface = pasynManager->findInterface(pasynUser, asynUInt32DigitalType, 1);
+  pasynUInt32Digital = (asynUInt32Digital *)pasynInterface->pinterface;
+  pasynUInt32Digital->registerInterruptUser(pasynInterface->drvPvt, pasynUser, testCallback,
+                                            pClient, 0xFFFFFFFF, &registrarPvt);
+}
+
+static void writerThread(void * /* pPvt */)
+{
+  /* Changes all the cards together, as one bus cycle would */
+  epicsUInt32 count;
+  int n, key, i;
+
+  for (n=1; n<=NUM_WRITES; n++) {
+    count = n & 0xffff;
+    key = epicsInterruptLock();
+    for (i=0; i<NUM_CARDS; i++) sims[i]->setInputs(count, 0xffff);
+    epicsInterruptUnlock(key);
+    epicsAtomicSetIntT(&numWrites, n);
+  }
+}
+
+MAIN(ipUnidigGroupTest)
+{
+  asynUser *pasynUserInputs, *pasynUser;
+  epicsInt32 inputs[NUM_CARDS];
+  epicsFloat64 sampleTime = 0.;
+  size_t nIn;
+  char portName[16];
+  int i, n, mismatches, callbacks[NUM_CARDS];
+
+  testPlan(8);
+  for (i=0; i<NUM_CARDS; i++) {
+    /* No interrupts, so only the group samples see the inputs */
+    sprintf(portName, "GROUP%d", i);
+    initIpUnidigSim(portName, 0, 1000, 1, 0, 0);
+    sims[i] = ipUnidigSimHardware::find(portName);
+  }
+  /* A long poll time, so samples come from GROUP_READ and the array reads */
+  testOk(ipUnidigCreateGroup(GROUP_PORT, "GROUP0 GROUP1,GROUP2", 10000) == 0, "ipUnidigCreateGroup");
+  for (i=0; i<NUM_CARDS; i++) registerClient(i, &clients[i]);
+  pasynInt32ArraySyncIO->connect(GROUP_PORT, 0, &pasynUserInputs, "GROUP_INPUTS");
+  pasynInt32SyncIO->connect(GROUP_PORT, 0, &pasynUser, "GROUP_READ");
+
+  /* GROUP_READ samples and publishes at once */
+  sims[0]->setInputs(0x11, 0xffff);
+  sims[1]->setInputs(0x22, 0xffff);
+  sims[2]->setInputs(0x33, 0xffff);
+  pasynInt32SyncIO->write(pasynUser, 1, TIMEOUT);
+  epicsThreadSleep(0.1);
+  testOk((clients[0].lastValue == 0x11) && (clients[1].lastValue == 0x22) &&
+         (clients[2].lastValue == 0x33), "GROUP_READ published %x %x %x",
+         clients[0].lastValue, clients[1].lastValue, clients[2].lastValue);
+  pasynInt32ArraySyncIO->read(pasynUserInputs, inputs, NUM_CARDS, &nIn, TIMEOUT);
+  testOk((nIn == NUM_CARDS) && (inputs[0] == 0x11) && (inputs[1] == 0x22) && (inputs[2] == 0x33),
+         "GROUP_INPUTS has one element per card");
+
+  /* Only the card that changed gets a callback */
+  for (i=0; i<NUM_CARDS; i++) callbacks[i] = epicsAtomicGetIntT(&clients[i].numCallbacks);
+  sims[1]->setInputs(0x23, 0xffff);
+  pasynInt32SyncIO->write(pasynUser, 1, TIMEOUT);
+  epicsThreadSleep(0.1);
+  testOk((epicsAtomicGetIntT(&clients[0].numCallbacks) == callbacks[0]) &&
+         (epicsAtomicGetIntT(&clients[1].numCallbacks) == callbacks[1] + 1) &&
+         (epicsAtomicGetIntT(&clients[2].numCallbacks) == callbacks[2]) &&
+         (clients[1].lastValue == 0x23), "only card 1 published, value=%x", clients[1].lastValue);
+  pasynInt32SyncIO->write(pasynUser, 1, TIMEOUT);
+  epicsThreadSleep(0.1);
+  testOk(epicsAtomicGetIntT(&clients[1].numCallbacks) == callbacks[1] + 1,
+         "an unchanged sample is not published");
+
+  /* The cards change together all the time, a sample must never split them */
+  for (i=0; i<NUM_CARDS; i++) sims[i]->setInputs(0, 0xffff);
+  epicsThreadCreate("groupTestWriter", epicsThreadPriorityMedium,
+                    epicsThreadGetStackSize(epicsThreadStackSmall),
+                    (EPICSTHREADFUNC)writerThread, NULL);
+  while (epicsAtomicGetIntT(&numWrites) == 0) epicsThreadSleep(0.001);
+  for (n=0, mismatches=0; epicsAtomicGetIntT(&numWrites) < NUM_WRITES; n++) {
+    pasynInt32ArraySyncIO->read(pasynUserInputs, inputs, NUM_CARDS, &nIn, TIMEOUT);
+    if ((inputs[1] != inputs[0]) || (inputs[2] != inputs[0])) mismatches++;
+  }
+  testOk(mismatches == 0, "%d samples, %d with the cards out of step", n, mismatches);
+  pasynInt32ArraySyncIO->read(pasynUserInputs, inputs, NUM_CARDS, &nIn, TIMEOUT);
+  testOk(inputs[0] == (NUM_WRITES & 0xffff), "last sample has the last write, %x", inputs[0]);
+
+  pasynFloat64SyncIO->connect(GROUP_PORT, 0, &pasynUser, "GROUP_SAMPLE_TIME");
+  pasynFloat64SyncIO->read(pasynUser, &sampleTime, TIMEOUT);
+  testOk(sampleTime > 0., "GROUP_SAMPLE_TIME=%f us", sampleTime);
+
+  return testDone();
+}
@@ -0,0 +1,296 @@
+/* ipUnidigHardware.cpp
+
+    Register access backends for the IP-Unidig driver.  See ipUnidigHardware.h.
+*/
+
+/* System includes */
+#include <stdio.h>
+#include <string.h>
+
+/* EPICS includes */
+#include <drvIpac.h>
+#include <errlog.h>
+#include <cantProceed.h>
+#include <epicsThread.h>
+#include <epicsInterrupt.h>
+#include <epicsString.h>
+#include <epicsTime.h>
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "ipUnidigHardware.h"
+
+/* The simulated card identifies itself as a Greenspring module */
+#define SIM_MANUFACTURER 0xF0
+#define SIM_DEFAULT_MODEL 0x68 /* IP-Unidig-I */
+
+/* Maximum number of input changes the generator makes without sleeping */
+#define SIM_MAX_BURST 1000
+
+static ipUnidigSimHardware *simList;
+static epicsMutexId simListLock;
+
+ipUnidigIpacHardware::ipUnidigIpacHardware(int carrier, int slot)
+  : carrier_(carrier), slot_(slot)
+{
+}
+
+volatile epicsUInt16 *ipUnidigIpacHardware::baseAddress(unsigned char *manufacturer, unsigned char *model)
+{
+  ipac_idProm_t *id;
+
+  if (ipmCheck(carrier_, slot_)) {
+    errlogPrintf("IpUnidig: bad carrier or slot\n");
+  }
+  id = (ipac_idProm_t *) ipmBaseAddr(carrier_, slot_, ipac_addrID);
+  *manufacturer = id->manufacturerId & 0xff;
+  *model = id->modelId & 0xff;
+  return (volatile epicsUInt16 *) ipmBaseAddr(carrier_, slot_, ipac_addrIO);
+}
+
+int ipUnidigIpacHardware::connectInterrupt(int intVec, ipUnidigIntFunc intFunc, int parameter)
+{
+  return ipmIntConnect(carrier_, slot_, intVec, intFunc, parameter);
+}
+
+void ipUnidigIpacHardware::enableInterrupts()
+{
+  /* Enable IPAC module interrupts and set module status. */
+  ipmIrqCmd(carrier_, slot_, 0, ipac_irqEnable);
+  ipmIrqCmd(carrier_, slot_, 0, ipac_statActive);
+}
+
+
+extern "C" {
+static void generatorThreadC(void *pPvt)
+{
+  ipUnidigSimHardware *pSim = (ipUnidigSimHardware *)pPvt;
+  pSim->generatorThread();
+}
+}
+
+ipUnidigSimHardware::ipUnidigSimHardware(const char *portName, int model)
+  : model_(model ? model : SIM_DEFAULT_MODEL),
+    inputs_(0), intFunc_(NULL), intParameter_(0), interruptsEnabled_(0),
+    generatorRunning_(0), generatorMask_(0), generatorRate_(0.)
+{
+  int i;
+
+  portName_ = epicsStrDup(portName);
+  for (i=0; i<SIM_NUM_REGISTERS; i++) registers_[i] = 0;
+  lock_ = epicsMutexMustCreate();
+  generatorEvent_ = epicsEventMustCreate(epicsEventEmpty);
+  if (!simListLock) simListLock = epicsMutexMustCreate();
+  epicsMutexMustLock(simListLock);
+  next_ = simList;
+  simList = this;
+  epicsMutexUnlock(simListLock);
+}
+
+ipUnidigSimHardware *ipUnidigSimHardware::find(const char *portName)
+{
+  ipUnidigSimHardware *pSim;
+
+  if (!simListLock) return NULL;
+  epicsMutexMustLock(simListLock);
+  for (pSim=simList; pSim; pSim=pSim->next_) {
+    if (strcmp(pSim->portName_, portName) == 0) break;
+  }
+  epicsMutexUnlock(simListLock);
+  return pSim;
+}
+
+volatile epicsUInt16 *ipUnidigSimHardware::baseAddress(unsigned char *manufacturer, unsigned char *model)
+{
+  *manufacturer = SIM_MANUFACTURER;
+  *model = (unsigned char) model_;
+  return registers_;
+}
+
+int ipUnidigSimHardware::connectInterrupt(int intVec, ipUnidigIntFunc intFunc, int parameter)
+{
+  epicsMutexMustLock(lock_);
+  /* Keep the vector in its register, as the module would */
+  registers_[SIM_INT_VEC] = (epicsUInt16) intVec;
+  intFunc_ = intFunc;
+  intParameter_ = parameter;
+  epicsMutexUnlock(lock_);
+  return 0;
+}
+
+void ipUnidigSimHardware::enableInterrupts()
+{
+  interruptsEnabled_ = 1;
+}
+
+void ipUnidigSimHardware::setInputs(epicsUInt32 value, epicsUInt32 mask)
+{
+  /* Changes the inputs in mask.  Edges which are enabled in the interrupt
+   * enable register and match the polarity register are made pending and
+   * the driver's interrupt function is called, as the IPAC carrier would.
+   * The driver writes the pending bits to the clear register, which is the
+   * same address, so the pending register is cleared when it returns.  The
+   * driver relies on epicsInterruptLock() to keep its interrupt function out,
+   * so the function is called with interrupts locked out, as in a real
+   * interrupt. */
+  epicsUInt32 inputs, rising, falling, enable, polarity, pending;
+  int key;
+
+  epicsMutexMustLock(lock_);
+  inputs = (inputs_ & ~mask) | (value & mask);
+  rising = inputs & ~inputs_;
+  falling = inputs_ & ~inputs;
+  inputs_ = inputs;
+  registers_[SIM_INPUT_LOW]  = (epicsUInt16) inputs;
+  registers_[SIM_INPUT_HIGH] = (epicsUInt16) (inputs >> 16);
+  enable   = registers_[SIM_INT_ENABLE_LOW] | ((epicsUInt32)registers_[SIM_INT_ENABLE_HIGH] << 16);
+  polarity = registers_[SIM_POLARITY_LOW]   | ((epicsUInt32)registers_[SIM_POLARITY_HIGH] << 16);
+  pending = enable & ((rising & polarity) | (falling & ~polarity));
+  if (pending && interruptsEnabled_ && intFunc_) {
+    registers_[SIM_PENDING_LOW]  = (epicsUInt16) pending;
+    registers_[SIM_PENDING_HIGH] = (epicsUInt16) (pending >> 16);
+    key = epicsInterruptLock();
+    intFunc_(intParameter_);
+    epicsInterruptUnlock(key);
+    registers_[SIM_PENDING_LOW]  = 0;
+    registers_[SIM_PENDING_HIGH] = 0;
+  }
+  epicsMutexUnlock(lock_);
+}
+
+epicsUInt32 ipUnidigSimHardware::getInputs()
+{
+  return inputs_;
+}
+
+epicsUInt32 ipUnidigSimHardware::getOutputs()
+{
+  return registers_[SIM_OUTPUT_LOW] | ((epicsUInt32)registers_[SIM_OUTPUT_HIGH] << 16);
+}
+
+int ipUnidigSimHardware::startGenerator(epicsUInt32 mask, double rate)
+{
+  /* Toggles the inputs in mask rate times per second.  A rate of 0 stops the
+   * generator. */
+  epicsMutexMustLock(lock_);
+  generatorMask_ = mask;
+  generatorRate_ = (rate > 0.) ? rate : 0.;
+  if (!generatorRunning_ && (generatorRate_ > 0.)) {
+    generatorRunning_ = 1;
+    epicsThreadCreate("ipUnidigSim",
+                      epicsThreadPriorityHigh,
+                      epicsThreadGetStackSize(epicsThreadStackMedium),
+                      (EPICSTHREADFUNC)generatorThreadC,
+                      this);
+  }
+  epicsMutexUnlock(lock_);
+  epicsEventSignal(generatorEvent_);
+  return 0;
+}
+
+void ipUnidigSimHardware::generatorThread()
+{
+  /* The sleep resolution is a clock tick, so each pass makes all the input
+   * changes that are due since the generator started, which keeps the
+   * average rate correct at rates above the clock rate */
+  epicsUInt64 start, done, due;
+  epicsUInt32 mask;
+  double rate, delay;
+  int n;
+
+  start = epicsMonotonicGet();
+  done = 0;
+  rate = 0.;
+  while (1) {
+    epicsMutexMustLock(lock_);
+    if (generatorRate_ != rate) {
+      rate = generatorRate_;
+      start = epicsMonotonicGet();
+      done = 0;
+    }
+    mask = generatorMask_;
+    if (rate == 0.) {
+      generatorRunning_ = 0;
+      epicsMutexUnlock(lock_);
+      return;
+    }
+    epicsMutexUnlock(lock_);
+    due = (epicsUInt64)((epicsMonotonicGet() - start) / 1.e9 * rate);
+    for (n=0; (done < due) && (n < SIM_MAX_BURST); n++, done++) {
+      setInputs(~inputs_, mask);
+    }
+    delay = (done < due) ? 0. : 1. / rate;
+    epicsEventWaitWithTimeout(generatorEvent_, delay);
+  }
+}
+
+
+extern "C" int ipUnidigSimSetInputs(const char *portName, epicsUInt32 value, epicsUInt32 mask)
+{
+  ipUnidigSimHardware *pSim = ipUnidigSimHardware::find(portName);
+
+  if (!pSim) return -1;
+  pSim->setInputs(value, mask);
+  return 0;
+}
+
+extern "C" int ipUnidigSimGetInputs(const char *portName, epicsUInt32 *value)
+{
+  ipUnidigSimHardware *pSim = ipUnidigSimHardware::find(portName);
+
+  if (!pSim) return -1;
+  *value = pSim->getInputs();
+  return 0;
+}
+
+extern "C" int ipUnidigSimGetOutputs(const char *portName, epicsUInt32 *value)
+{
+  ipUnidigSimHardware *pSim = ipUnidigSimHardware::find(portName);
+
+  if (!pSim) return -1;
+  *value = pSim->getOutputs();
+  return 0;
+}
+
+extern "C" int ipUnidigSimGenerate(const char *portName, epicsUInt32 mask, double rate)
+{
+  ipUnidigSimHardware *pSim = ipUnidigSimHardware::find(portName);
+
+  if (!pSim) return -1;
+  return pSim->startGenerator(mask, rate);
+}
+
+/* iocsh functions */
+static const iocshArg setInputsArg0 = { "Port name",iocshArgString};
+static const iocshArg setInputsArg1 = { "value",iocshArgInt};
+static const iocshArg setInputsArg2 = { "mask",iocshArgInt};
+static const iocshArg * const setInputsArgs[3] = {&setInputsArg0,
+                                                  &setInputsArg1,
+                                                  &setInputsArg2};
+static const iocshFuncDef setInputsFuncDef = {"ipUnidigSimSetInputs",3,setInputsArgs};
+static void setInputsCallFunc(const iocshArgBuf *args)
+{
+  if (ipUnidigSimSetInputs(args[0].sval, args[1].ival, args[2].ival))
+    printf("ipUnidigSimSetInputs: %s is not a simulated IP-Unidig\n", args[0].sval);
+}
+
+static const iocshArg generateArg0 = { "Port name",iocshArgString};
+static const iocshArg generateArg1 = { "mask",iocshArgInt};
+static const iocshArg generateArg2 = { "rate",iocshArgDouble};
+static const iocshArg * const generateArgs[3] = {&generateArg0,
+                                                 &generateArg1,
+                                                 &generateArg2};
+static const iocshFuncDef generateFuncDef = {"ipUnidigSimGenerate",3,generateArgs};
+static void generateCallFunc(const iocshArgBuf *args)
+{
+  if (ipUnidigSimGenerate(args[0].sval, args[1].ival, args[2].dval))
+    printf("ipUnidigSimGenerate: %s is not a simulated IP-Unidig\n", args[0].sval);
+}
+
+void ipUnidigSimRegister(void)
+{
+  iocshRegister(&setInputsFuncDef,setInputsCallFunc);
+  iocshRegister(&generateFuncDef,generateCallFunc);
+}
+
+epicsExportRegistrar(ipUnidigSimRegister);
@@ -0,0 +1,112 @@
+/* ipUnidigHardware.h
+
+    Register access backends for the IP-Unidig driver.
+
+    The driver still reads and writes the registers through the raw
+    pointers in ipUnidigRegisters, so there are no virtual calls in the
+    interrupt or polling paths.  A backend only provides the register block,
+    the module identification and the interrupt connection.
+
+    ipUnidigIpacHardware is the memory mapped IPAC module.
+    ipUnidigSimHardware is a register block in memory whose inputs are
+    driven by software, and which calls the driver's interrupt function
+    when an enabled edge occurs, so the driver can be run without hardware.
+*/
+
+#ifndef IP_UNIDIG_HARDWARE_H
+#define IP_UNIDIG_HARDWARE_H
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+
+typedef void (*ipUnidigIntFunc)(int parameter);
+
+class ipUnidigHardware
+{
+public:
+  virtual ~ipUnidigHardware() {}
+  /* Returns the base of the module's I/O space and its ID prom contents */
+  virtual volatile epicsUInt16 *baseAddress(unsigned char *manufacturer, unsigned char *model) = 0;
+  virtual int connectInterrupt(int intVec, ipUnidigIntFunc intFunc, int parameter) = 0;
+  virtual void enableInterrupts() = 0;
+  virtual const char *name() = 0;
+};
+
+class ipUnidigIpacHardware : public ipUnidigHardware
+{
+public:
+  ipUnidigIpacHardware(int carrier, int slot);
+  virtual volatile epicsUInt16 *baseAddress(unsigned char *manufacturer, unsigned char *model);
+  virtual int connectInterrupt(int intVec, ipUnidigIntFunc intFunc, int parameter);
+  virtual void enableInterrupts();
+  virtual const char *name() { return "IPAC"; }
+
+private:
+  int carrier_;
+  int slot_;
+};
+
+/* Register offsets of the Greenspring modules, in 16-bit words */
+#define SIM_OUTPUT_LOW      0x0
+#define SIM_OUTPUT_HIGH     0x1
+#define SIM_INPUT_LOW       0x2
+#define SIM_INPUT_HIGH      0x3
+#define SIM_INT_VEC         0x8
+#define SIM_INT_ENABLE_LOW  0x9
+#define SIM_INT_ENABLE_HIGH 0xa
+#define SIM_POLARITY_LOW    0xb
+#define SIM_POLARITY_HIGH   0xc
+#define SIM_PENDING_LOW     0xd
+#define SIM_PENDING_HIGH    0xe
+#define SIM_NUM_REGISTERS   0x10
+
+class ipUnidigSimHardware : public ipUnidigHardware
+{
+public:
+  ipUnidigSimHardware(const char *portName, int model);
+  virtual volatile epicsUInt16 *baseAddress(unsigned char *manufacturer, unsigned char *model);
+  virtual int connectInterrupt(int intVec, ipUnidigIntFunc intFunc, int parameter);
+  virtual void enableInterrupts();
+  virtual const char *name() { return "simulated"; }
+  void setInputs(epicsUInt32 value, epicsUInt32 mask);
+  epicsUInt32 getInputs();
+  epicsUInt32 getOutputs();
+  int startGenerator(epicsUInt32 mask, double rate);
+  void generatorThread();
+  static ipUnidigSimHardware *find(const char *portName);
+
+private:
+  char *portName_;
+  int model_;
+  volatile epicsUInt16 registers_[SIM_NUM_REGISTERS];
+  epicsUInt32 inputs_;
+  ipUnidigIntFunc intFunc_;
+  int intParameter_;
+  int interruptsEnabled_;
+  /* Serializes input changes, and so the simulated interrupts */
+  epicsMutexId lock_;
+  epicsEventId generatorEvent_;
+  int generatorRunning_;
+  epicsUInt32 generatorMask_;
+  double generatorRate_;
+  ipUnidigSimHardware *next_;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Functions to drive a simulated card from test programs.  They return 0 on
+ * success and -1 if portName is not a simulated card. */
+int ipUnidigSimSetInputs(const char *portName, epicsUInt32 value, epicsUInt32 mask);
+int ipUnidigSimGetInputs(const char *portName, epicsUInt32 *value);
+int ipUnidigSimGetOutputs(const char *portName, epicsUInt32 *value);
+int ipUnidigSimGenerate(const char *portName, epicsUInt32 mask, double rate);
+/* Creates a driver port on a simulated card, in drvIpUnidig.cpp */
+int initIpUnidigSim(const char *portName, int model, int msecPoll, int intVec,
+                    int risingMask, int fallingMask);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IP_UNIDIG_HARDWARE_H */
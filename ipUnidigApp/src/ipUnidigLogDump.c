@@ -0,0 +1,90 @@
+/* ipUnidigLogDump.c
+
+    Converts an IP-Unidig event log, written with ipUnidigLogEnable, to text.
+    The records are printed oldest first, with the time, the event number,
+    the inputs, the interrupt and rising edge masks, and the output shadow.
+
+    usage: ipUnidigLogDump [-c] [-n records] file
+      -c  Write comma separated values with a header line.
+      -n  Only print the last records.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ipUnidigEventLog.h"
+
+/* Matches LOG_HEADER_SIZE in ipUnidigEventLog.c */
+#define LOG_HEADER_SIZE 64
+
+static void usage()
+{
+  fprintf(stderr, "usage: ipUnidigLogDump [-c] [-n records] file\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  FILE *fp;
+  ipUnidigLogHeader header;
+  ipUnidigLogRecord record;
+  uint64_t first, i, last = 0, bad = 0;
+  struct tm tm;
+  time_t sec;
+  char timeString[32];
+  int csv = 0, opt;
+
+  while ((opt = getopt(argc, argv, "cn:")) != -1) {
+    switch (opt) {
+      case 'c': csv = 1; break;
+      case 'n': last = strtoull(optarg, NULL, 10); break;
+      default: usage();
+    }
+  }
+  if (optind != argc - 1) usage();
+  fp = fopen(argv[optind], "rb");
+  if (!fp) {
+    perror(argv[optind]);
+    return 1;
+  }
+  if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+      (header.magic != IP_UNIDIG_LOG_MAGIC) || (header.version != IP_UNIDIG_LOG_VERSION) ||
+      (header.recordSize != sizeof(ipUnidigLogRecord)) || (header.numRecords == 0)) {
+    fprintf(stderr, "ipUnidigLogDump: %s is not an IP-Unidig event log\n", argv[optind]);
+    return 1;
+  }
+  first = (header.count > header.numRecords) ? header.count - header.numRecords : 0;
+  if (last && (header.count - first > last)) first = header.count - last;
+  if (csv) {
+    printf("time,seq,inputs,interrupt_mask,rising_mask,outputs\n");
+  } else {
+    printf("# port %.32s, %llu records written, %u in the log, %s\n",
+           header.portName, (unsigned long long)header.count, header.numRecords,
+           header.frozen ? "frozen" : "not frozen");
+  }
+  for (i=first; i<header.count; i++) {
+    if ((fseek(fp, LOG_HEADER_SIZE + (long)(i % header.numRecords) * sizeof(record), SEEK_SET) != 0) ||
+        (fread(&record, sizeof(record), 1, fp) != 1)) {
+      fprintf(stderr, "ipUnidigLogDump: %s is truncated\n", argv[optind]);
+      return 1;
+    }
+    /* A record that was being written when the IOC stopped */
+    if (record.seq != i + 1) {
+      bad++;
+      continue;
+    }
+    sec = record.sec;
+    gmtime_r(&sec, &tm);
+    strftime(timeString, sizeof(timeString), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf(csv ? "%s.%09uZ,%llu,0x%08x,0x%08x,0x%08x,0x%08x\n"
+               : "%s.%09uZ %10llu inputs=%08x interrupts=%08x rising=%08x outputs=%08x\n",
+           timeString, record.nsec, (unsigned long long)record.seq,
+           record.inputs, record.interruptMask, record.risingMask, record.outputs);
+  }
+  fclose(fp);
+  if (bad) fprintf(stderr, "ipUnidigLogDump: %llu incomplete records skipped\n", (unsigned long long)bad);
+  return 0;
+}
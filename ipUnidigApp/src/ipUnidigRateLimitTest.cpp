@@ -0,0 +1,132 @@
+/* ipUnidigRateLimitTest.cpp
+
+    Regression test of the per-bit callback rate limit (MAX_CALLBACK_RATE),
+    on a simulated card.
+
+    A burst of edges on a limited bit must give at most one callback per
+    interval, the deferred callback must carry the latest state, and the
+    suppressed edges must be counted.  A bit without a limit must still get a
+    callback for every edge.
+*/
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynUInt32Digital.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define TEST_PORT "RATE"
+#define TIMEOUT 1.0
+#define LIMITED_BIT   0x1
+#define UNLIMITED_BIT 0x2
+
+typedef struct {
+  int numCallbacks;
+  epicsUInt32 lastValue;
+} testClient;
+
+static testClient limitedClient, unlimitedClient;
+
+static void testCallback(void *userPvt, asynUser * /* pasynUser */, epicsUInt32 data)
+{
+  testClient *pClient = (testClient *)userPvt;
+
+  pClient->lastValue = data;
+  epicsAtomicIncrIntT(&pClient->numCallbacks);
+}
+
+static void registerClient(epicsUInt32 mask, testClient *pClient)
+{
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
+  asynUInt32Digital *pasynUInt32Digital;
+  void *registrarPvt;
+
+  pasynUInt32DigitalSyncIO->connect(TEST_PORT, 0, &pasynUser, "DIGITAL_INPUT");
+  pasynInterface = pasynManager->findInterface(pasynUser, asynUInt32DigitalType, 1);
+  pasynUInt32Digital = (asynUInt32Digital *)pasynInterface->pinterface;
+  pasynUInt32Digital->registerInterruptUser(pasynInterface->drvPvt, pasynUser, testCallback,
+                                            pClient, mask, &registrarPvt);
+}
+
+static epicsInt32 readInt32(const char *drvInfo, int addr)
+{
+  asynUser *pasynUser;
+  epicsInt32 value = -1;
+
+  pasynInt32SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeFloat64(const char *drvInfo, int addr, epicsFloat64 value)
+{
+  asynUser *pasynUser;
+
+  pasynFloat64SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynFloat64SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+}
+
+MAIN(ipUnidigRateLimitTest)
+{
+  ipUnidigSimHardware *pSim;
+  int i, callbacks, suppressed;
+
+  testPlan(7);
+  /* Interrupts on both edges of both bits */
+  initIpUnidigSim(TEST_PORT, 0, 100, 1, LIMITED_BIT | UNLIMITED_BIT, LIMITED_BIT | UNLIMITED_BIT);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  registerClient(LIMITED_BIT, &limitedClient);
+  registerClient(UNLIMITED_BIT, &unlimitedClient);
+  /* One callback every 200 ms on bit 0 */
+  writeFloat64("MAX_CALLBACK_RATE", 0, 5.);
+  epicsThreadSleep(0.1);
+
+  /* 101 edges in a burst much shorter than the interval, ending high */
+  for (i=0; i<=100; i++) pSim->setInputs((i & 1) ? 0 : LIMITED_BIT, LIMITED_BIT);
+  epicsThreadSleep(0.1);
+  callbacks = epicsAtomicGetIntT(&limitedClient.numCallbacks);
+  testOk(callbacks <= 1, "burst gives at most 1 callback within the interval, got %d", callbacks);
+  epicsThreadSleep(0.4);
+  callbacks = epicsAtomicGetIntT(&limitedClient.numCallbacks);
+  testOk((callbacks >= 1) && (callbacks <= 2), "burst coalesced to 1-2 callbacks, got %d", callbacks);
+  testOk(limitedClient.lastValue == LIMITED_BIT, "deferred callback has the latest state, %x",
+         limitedClient.lastValue);
+  suppressed = readInt32("SUPPRESSED_EDGES", 0);
+  testOk(suppressed == 101 - callbacks, "every edge without a callback is suppressed, %d",
+         suppressed);
+
+  /* Edges slower than the poller on the unlimited bit all give callbacks */
+  for (i=0; i<10; i++) {
+    pSim->setInputs((i & 1) ? 0 : UNLIMITED_BIT, UNLIMITED_BIT);
+    epicsThreadSleep(0.02);
+  }
+  epicsThreadSleep(0.1);
+  callbacks = epicsAtomicGetIntT(&unlimitedClient.numCallbacks);
+  testOk(callbacks == 10, "unlimited bit gets every edge, %d callbacks", callbacks);
+  testOk(readInt32("SUPPRESSED_EDGES", 1) == 0, "no suppressed edges on the unlimited bit");
+
+  /* Removing the limit delivers edges directly again */
+  writeFloat64("MAX_CALLBACK_RATE", 0, 0.);
+  callbacks = epicsAtomicGetIntT(&limitedClient.numCallbacks);
+  for (i=0; i<4; i++) {
+    pSim->setInputs((i & 1) ? LIMITED_BIT : 0, LIMITED_BIT);
+    epicsThreadSleep(0.02);
+  }
+  epicsThreadSleep(0.1);
+  callbacks = epicsAtomicGetIntT(&limitedClient.numCallbacks) - callbacks;
+  testOk(callbacks == 4, "no limit after MAX_CALLBACK_RATE=0, %d callbacks", callbacks);
+
+  return testDone();
+}
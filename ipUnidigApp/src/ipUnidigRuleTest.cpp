@@ -0,0 +1,147 @@
+/* ipUnidigRuleTest.cpp
+
+    Regression test of the interlock rules (ipUnidigAddRule, RULE_ENABLE,
+    RULE_HITS), on a simulated card.
+
+    The simulator calls the interrupt function before setInputs() returns,
+    so an output driven by a rule on interrupting inputs must already be
+    right when it returns, for every combination of the inputs.  The test
+    keeps interrupts locked out meanwhile, so the poller cannot have set it.
+    A rule on a polled input must follow it within a few poll periods.
+    DIGITAL_OUTPUT writes must not change the output of an enabled rule,
+    and must once it is disabled.
+*/
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsInterrupt.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+extern "C" int ipUnidigAddRule(const char *portName, const char *rule);
+
+#define TEST_PORT "RULE"
+#define TIMEOUT 1.0
+#define INPUT_BITS  0x7         /* in0-in2, interrupts on both edges */
+#define POLLED_BIT  0x100000    /* in20, no interrupts */
+#define RULE_OUT    0x100       /* out8 = in0 AND NOT in1 OR in2 */
+#define POLLED_OUT  0x200       /* out9 = in20 */
+#define MSEC_POLL 20
+#define STATS_PERIOD 0.05
+#define NUM_PASSES 10
+
+static epicsInt32 readInt32(const char *drvInfo, int addr)
+{
+  asynUser *pasynUser;
+  epicsInt32 value = -1;
+
+  pasynInt32SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeInt32(const char *drvInfo, int addr, epicsInt32 value)
+{
+  asynUser *pasynUser;
+
+  pasynInt32SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynInt32SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+}
+
+static void writeFloat64(const char *drvInfo, int addr, epicsFloat64 value)
+{
+  asynUser *pasynUser;
+
+  pasynFloat64SyncIO->connect(TEST_PORT, addr, &pasynUser, drvInfo);
+  pasynFloat64SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+}
+
+static int ruleResult(epicsUInt32 inputs)
+{
+  return ((inputs & 0x1) && !(inputs & 0x2)) || (inputs & 0x4);
+}
+
+MAIN(ipUnidigRuleTest)
+{
+  ipUnidigSimHardware *pSim;
+  asynUser *pasynUserOutput;
+  epicsUInt32 inputs, outputs;
+  int i, key, result, lastResult, hits, wrong;
+
+  testPlan(13);
+  initIpUnidigSim(TEST_PORT, 0, MSEC_POLL, 1, INPUT_BITS, INPUT_BITS);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  writeFloat64("STATS_PERIOD", 0, STATS_PERIOD);
+  pasynUInt32DigitalSyncIO->connect(TEST_PORT, 0, &pasynUserOutput, "DIGITAL_OUTPUT");
+
+  /* Rules that do not compile are refused */
+  testOk(ipUnidigAddRule(TEST_PORT, "out8 = in0 AND") != 0, "rule ending with AND refused");
+  testOk(ipUnidigAddRule(TEST_PORT, "in8 = in0") != 0, "rule not starting with outN refused");
+  testOk(ipUnidigAddRule(TEST_PORT, "out8 = in0 & !in0") != 0, "term needing in0 on and off refused");
+  testOk(ipUnidigAddRule(TEST_PORT, "out8 = in0 AND NOT in1 OR in2") == 0, "rule 0 added");
+  testOk(ipUnidigAddRule(TEST_PORT, "out9 = in20") == 0, "rule 1 added");
+
+  /* Walk the inputs through all their combinations in Gray code order, the
+   * output must be right as soon as each edge has been taken */
+  for (i=0, wrong=0, hits=0, lastResult=0; i<NUM_PASSES * 8; i++) {
+    inputs = ((i + 1) ^ ((i + 1) >> 1)) & INPUT_BITS;
+    key = epicsInterruptLock();
+    pSim->setInputs(inputs, INPUT_BITS);
+    outputs = pSim->getOutputs();
+    epicsInterruptUnlock(key);
+    result = ruleResult(inputs);
+    if (result && !lastResult) hits++;
+    lastResult = result;
+    if (((outputs & RULE_OUT) != 0) != result) {
+      testDiag("inputs=%x outputs=%x", inputs, outputs);
+      wrong++;
+    }
+  }
+  testOk(wrong == 0, "%d combinations, %d with the wrong output", NUM_PASSES * 8, wrong);
+  epicsThreadSleep(3 * STATS_PERIOD);
+  testOk(readInt32("RULE_HITS", 0) == hits, "RULE_HITS=%d, expected %d", readInt32("RULE_HITS", 0), hits);
+
+  /* A polled input drives its rule from the poller */
+  pSim->setInputs(POLLED_BIT, POLLED_BIT);
+  epicsThreadSleep(5 * MSEC_POLL / 1000.);
+  testOk((pSim->getOutputs() & POLLED_OUT) != 0, "polled rule output on");
+  pSim->setInputs(0, POLLED_BIT);
+  epicsThreadSleep(5 * MSEC_POLL / 1000.);
+  testOk((pSim->getOutputs() & POLLED_OUT) == 0, "polled rule output off");
+
+  /* DIGITAL_OUTPUT leaves the output of an enabled rule alone */
+  pSim->setInputs(0, INPUT_BITS);
+  pasynUInt32DigitalSyncIO->write(pasynUserOutput, RULE_OUT | 0x1, RULE_OUT | 0x1, TIMEOUT);
+  testOk((pSim->getOutputs() & (RULE_OUT | 0x1)) == 0x1, "write to rule output ignored, outputs=%x",
+         pSim->getOutputs());
+
+  /* Once disabled, the output is DIGITAL_OUTPUT's and the inputs leave it alone */
+  writeInt32("RULE_ENABLE", 0, 0);
+  pasynUInt32DigitalSyncIO->write(pasynUserOutput, RULE_OUT, RULE_OUT, TIMEOUT);
+  pSim->setInputs(0x4, INPUT_BITS);
+  pSim->setInputs(0, INPUT_BITS);
+  testOk((pSim->getOutputs() & RULE_OUT) != 0, "disabled rule output written, outputs=%x",
+         pSim->getOutputs());
+
+  /* Enabling the rule again drives the output from the inputs at once */
+  epicsThreadSleep(0.1);
+  writeInt32("RULE_ENABLE", 0, 1);
+  testOk((pSim->getOutputs() & RULE_OUT) == 0, "enabled rule output follows the inputs, outputs=%x",
+         pSim->getOutputs());
+  pSim->setInputs(0x4, INPUT_BITS);
+  testOk((pSim->getOutputs() & RULE_OUT) != 0, "enabled rule output on, outputs=%x",
+         pSim->getOutputs());
+
+  return testDone();
+}
@@ -0,0 +1,138 @@
+/* ipUnidigSchedulerTest.cpp
+
+    Regression test of the shared scheduler (ipUnidigSchedulerConfig), with
+    several simulated cards serviced by two worker threads.
+
+    Every card must get its interrupt callbacks, in order and ending with
+    its latest inputs, and its polled inputs must still be polled.  A card
+    must never be serviced by two workers at once.
+*/
+
+/* System includes */
+#include <stdio.h>
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsAtomic.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynUInt32Digital.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+extern "C" int ipUnidigSchedulerConfig(int numThreads, int priority);
+
+#define NUM_CARDS 4
+#define NUM_STEPS 200
+#define MSEC_POLL 20
+#define COUNT_BITS  0xff    /* Interrupts on both edges */
+#define POLLED_BIT  0x100   /* No interrupts */
+#define TIMEOUT 1.0
+
+typedef struct {
+  char portName[16];
+  ipUnidigSimHardware *pSim;
+  int numCallbacks;
+  int inCallback;
+  int overlaps;
+  int outOfOrder;
+  epicsUInt32 lastCount;
+  int numPolled;
+  epicsUInt32 lastPolled;
+} testCard;
+
+static testCard cards[NUM_CARDS];
+
+static void countCallback(void *userPvt, asynUser * /* pasynUser */, epicsUInt32 data)
+{
+  testCard *pCard = (testCard *)userPvt;
+
+  /* A second worker servicing the same card would get in here too */
+  if (epicsAtomicIncrIntT(&pCard->inCallback) != 1) epicsAtomicIncrIntT(&pCard->overlaps);
+  if ((pCard->numCallbacks > 0) && (data <= pCard->lastCount)) pCard->outOfOrder++;
+  pCard->lastCount = data;
+  pCard->numCallbacks++;
+  epicsThreadSleep(0.001);
+  epicsAtomicDecrIntT(&pCard->inCallback);
+}
+
+static void polledCallback(void *userPvt, asynUser * /* pasynUser */, epicsUInt32 data)
+{
+  testCard *pCard = (testCard *)userPvt;
+
+  pCard->lastPolled = data;
+  epicsAtomicIncrIntT(&pCard->numPolled);
+}
+
+static void registerClient(testCard *pCard, epicsUInt32 mask, interruptCallbackUInt32Digital callback)
+{
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
+  asynUInt32Digital *pasynUInt32Digital;
+  void *registrarPvt;
+
+  pasynUInt32DigitalSyncIO->connect(pCard->portName, 0, &pasynUser, "DIGITAL_INPUT");
+  pasynInterface = pasynManager->findInterface(pasynUser, asynUInt32DigitalType, 1);
+  pasynUInt32Digital = (asynUInt32Digital *)pasynInterface->pinterface;
+  pasynUInt32Digital->registerInterruptUser(pasynInterface->drvPvt, pasynUser, callback,
+                                            pCard, mask, &registrarPvt);
+}
+
+MAIN(ipUnidigSchedulerTest)
+{
+  testCard *pCard;
+  int i, step, ok, overlaps;
+
+  testPlan(6);
+  testOk(ipUnidigSchedulerConfig(2, 0) == 0, "ipUnidigSchedulerConfig(2, 0)");
+  for (i=0; i<NUM_CARDS; i++) {
+    pCard = &cards[i];
+    sprintf(pCard->portName, "SCHED%d", i);
+    initIpUnidigSim(pCard->portName, 0, MSEC_POLL, 1, COUNT_BITS, COUNT_BITS);
+    pCard->pSim = ipUnidigSimHardware::find(pCard->portName);
+    registerClient(pCard, COUNT_BITS, countCallback);
+    registerClient(pCard, POLLED_BIT, polledCallback);
+  }
+  epicsThreadSleep(0.2);
+
+  /* Count up on all the cards at once, faster than the callbacks */
+  for (step=1; step<NUM_STEPS; step++) {
+    for (i=0; i<NUM_CARDS; i++) cards[i].pSim->setInputs(step, COUNT_BITS);
+    if ((step % 10) == 0) epicsThreadSleep(0.002);
+  }
+  epicsThreadSleep(0.5);
+  for (i=0, ok=1; i<NUM_CARDS; i++) {
+    if ((cards[i].numCallbacks == 0) || (cards[i].lastCount != NUM_STEPS - 1)) {
+      testDiag("%s: %d callbacks, last=%d", cards[i].portName, cards[i].numCallbacks,
+               cards[i].lastCount);
+      ok = 0;
+    }
+  }
+  testOk(ok, "every card got callbacks ending with its latest inputs");
+  for (i=0, ok=1; i<NUM_CARDS; i++) {
+    if (cards[i].outOfOrder) ok = 0;
+  }
+  testOk(ok, "callbacks of each card are in order");
+  for (i=0, overlaps=0; i<NUM_CARDS; i++) overlaps += epicsAtomicGetIntT(&cards[i].overlaps);
+  testOk(overlaps == 0, "no card serviced by two workers at once, %d overlaps", overlaps);
+
+  /* Inputs without interrupts are found by the scheduled polls */
+  for (i=0; i<NUM_CARDS; i++) cards[i].pSim->setInputs(POLLED_BIT, POLLED_BIT);
+  epicsThreadSleep(5 * MSEC_POLL / 1000.);
+  for (i=0, ok=1; i<NUM_CARDS; i++) {
+    if ((epicsAtomicGetIntT(&cards[i].numPolled) == 0) || (cards[i].lastPolled != POLLED_BIT)) ok = 0;
+  }
+  testOk(ok, "polled bit seen on every card within 5 poll periods");
+  for (i=0; i<NUM_CARDS; i++) cards[i].pSim->setInputs(0, POLLED_BIT);
+  epicsThreadSleep(5 * MSEC_POLL / 1000.);
+  for (i=0, ok=1; i<NUM_CARDS; i++) {
+    if (cards[i].lastPolled != 0) ok = 0;
+  }
+  testOk(ok, "polled bit cleared on every card");
+
+  return testDone();
+}
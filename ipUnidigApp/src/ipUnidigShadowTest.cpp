@@ -0,0 +1,98 @@
+/* ipUnidigShadowTest.cpp
+
+    Regression test of the shadow register output path, on a simulated card.
+
+    Masked DIGITAL_OUTPUT writes must only change the bits in the mask, even
+    though the output registers are never read back.  OUTPUT_ACCESSES_SAVED
+    must count the bus accesses saved against a read-modify-write of both
+    half-words: 8 for a write that changes nothing, 7 for a write that
+    changes one half-word and 6 for one that changes both.
+*/
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynInt32SyncIO.h>
+#include <asynFloat64SyncIO.h>
+#include <asynUInt32DigitalSyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define TEST_PORT "SHADOW"
+#define TIMEOUT 1.0
+#define STATS_PERIOD 0.05
+
+static asynUser *pasynUserOutput;
+
+static epicsInt32 readSaved()
+{
+  asynUser *pasynUser;
+  epicsInt32 value = -1;
+
+  /* Wait for the statistics to be published */
+  epicsThreadSleep(3 * STATS_PERIOD);
+  pasynInt32SyncIO->connect(TEST_PORT, 0, &pasynUser, "OUTPUT_ACCESSES_SAVED");
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeOutputs(epicsUInt32 value, epicsUInt32 mask)
+{
+  pasynUInt32DigitalSyncIO->write(pasynUserOutput, value, mask, TIMEOUT);
+}
+
+MAIN(ipUnidigShadowTest)
+{
+  ipUnidigSimHardware *pSim;
+  asynUser *pasynUser;
+  epicsInt32 saved, start;
+  int i;
+
+  testPlan(10);
+  initIpUnidigSim(TEST_PORT, 0, 100, 1, 0, 0);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  pasynFloat64SyncIO->connect(TEST_PORT, 0, &pasynUser, "STATS_PERIOD");
+  pasynFloat64SyncIO->write(pasynUser, STATS_PERIOD, TIMEOUT);
+  pasynFloat64SyncIO->disconnect(pasynUser);
+  pasynUInt32DigitalSyncIO->connect(TEST_PORT, 0, &pasynUserOutput, "DIGITAL_OUTPUT");
+  start = readSaved();
+  testOk(start == 0, "OUTPUT_ACCESSES_SAVED starts at 0, %d", start);
+
+  /* Masked writes change only their own bits */
+  writeOutputs(0x00000005, 0x0000000f);
+  testOk(pSim->getOutputs() == 0x00000005, "low half-word written, outputs=%x", pSim->getOutputs());
+  saved = readSaved();
+  testOk(saved == 7, "one half-word changed saves 7, %d", saved);
+
+  writeOutputs(0xffff0000, 0x00ff0000);
+  testOk(pSim->getOutputs() == 0x00ff0005, "high half-word written, low kept, outputs=%x",
+         pSim->getOutputs());
+  testOk(readSaved() - saved == 7, "second half-word write saves 7");
+  saved = readSaved();
+
+  writeOutputs(0x00000000, 0x00000001);
+  testOk(pSim->getOutputs() == 0x00ff0004, "single bit cleared, outputs=%x", pSim->getOutputs());
+  saved = readSaved();
+
+  /* Writing the current value is not written to the card at all */
+  writeOutputs(0x00ff0004, 0xffffffff);
+  testOk(readSaved() - saved == 8, "unchanged write saves 8");
+  saved = readSaved();
+
+  writeOutputs(0x12345678, 0xffffffff);
+  testOk(pSim->getOutputs() == 0x12345678, "full write, outputs=%x", pSim->getOutputs());
+  testOk(readSaved() - saved == 6, "both half-words changed saves 6");
+  saved = readSaved();
+
+  /* A burst of writes that each toggle bit 0 is counted exactly */
+  for (i=0; i<100; i++) writeOutputs((i & 1) ? 0 : 1, 0x1);
+  testOk(readSaved() - saved == 100 * 7, "100 single bit writes save 700, %d",
+         readSaved() - saved);
+
+  return testDone();
+}
@@ -0,0 +1,262 @@
+/* ipUnidigShm.c
+
+    Publication of the IP-Unidig inputs in POSIX shared memory.  See
+    ipUnidigShm.h.
+
+    This file is built into the driver library, and into the ipUnidigShm
+    reader library, which does not need EPICS.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ipUnidigShm.h"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct ipUnidigShm {
+  void *base;
+  size_t size;
+  ipUnidigShmHeader *pHeader;
+  ipUnidigShmState *pState;
+  ipUnidigShmEvent *pEvents;
+  uint32_t mask;
+  /* Writer only */
+  uint64_t eventCount;
+  uint64_t updateCount;
+};
+
+#define WRITE_BARRIER() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define READ_BARRIER()  __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+static size_t segmentSize(uint32_t ringSize)
+{
+  return IP_UNIDIG_SHM_LINE + sizeof(ipUnidigShmState) + ringSize * sizeof(ipUnidigShmEvent);
+}
+
+static ipUnidigShm *mapSegment(int fd, size_t size, int prot)
+{
+  ipUnidigShm *pShm;
+  void *base;
+
+  base = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return NULL;
+  pShm = (ipUnidigShm *)calloc(1, sizeof(ipUnidigShm));
+  if (!pShm) {
+    munmap(base, size);
+    return NULL;
+  }
+  pShm->base = base;
+  pShm->size = size;
+  pShm->pHeader = (ipUnidigShmHeader *)base;
+  pShm->pState = (ipUnidigShmState *)((char *)base + IP_UNIDIG_SHM_LINE);
+  pShm->pEvents = (ipUnidigShmEvent *)(pShm->pState + 1);
+  return pShm;
+}
+
+ipUnidigShm *ipUnidigShmCreate(const char *name, const char *portName, uint32_t ringSize)
+{
+  ipUnidigShm *pShm;
+  size_t size;
+  int fd;
+
+  if ((ringSize == 0) || (ringSize & (ringSize - 1))) {
+    fprintf(stderr, "ipUnidigShmCreate: ring size %u is not a power of 2\n", ringSize);
+    return NULL;
+  }
+  size = segmentSize(ringSize);
+  fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    perror("ipUnidigShmCreate: shm_open");
+    return NULL;
+  }
+  if (ftruncate(fd, size) != 0) {
+    perror("ipUnidigShmCreate: ftruncate");
+    close(fd);
+    return NULL;
+  }
+  pShm = mapSegment(fd, size, PROT_READ | PROT_WRITE);
+  if (!pShm) {
+    perror("ipUnidigShmCreate: mmap");
+    return NULL;
+  }
+  /* Readers check the magic number last */
+  memset(pShm->base, 0, size);
+  pShm->mask = ringSize - 1;
+  pShm->pHeader->version = IP_UNIDIG_SHM_VERSION;
+  pShm->pHeader->ringSize = ringSize;
+  pShm->pHeader->eventSize = sizeof(ipUnidigShmEvent);
+  strncpy(pShm->pHeader->portName, portName, sizeof(pShm->pHeader->portName) - 1);
+  WRITE_BARRIER();
+  pShm->pHeader->magic = IP_UNIDIG_SHM_MAGIC;
+  return pShm;
+}
+
+void ipUnidigShmWriteState(ipUnidigShm *pShm, uint32_t inputs, uint32_t outputs,
+                           uint32_t sec, uint32_t nsec)
+{
+  ipUnidigShmState *pState = pShm->pState;
+
+  pState->seq++;
+  WRITE_BARRIER();
+  pState->inputs = inputs;
+  pState->outputs = outputs;
+  pState->sec = sec;
+  pState->nsec = nsec;
+  pState->eventCount = pShm->eventCount;
+  pState->updateCount = ++pShm->updateCount;
+  WRITE_BARRIER();
+  pState->seq++;
+}
+
+void ipUnidigShmWriteEvent(ipUnidigShm *pShm, uint32_t bits, uint32_t interruptMask,
+                           uint32_t risingMask, uint32_t outputs, uint32_t sec, uint32_t nsec)
+{
+  ipUnidigShmEvent *pEvent = &pShm->pEvents[pShm->eventCount & pShm->mask];
+
+  pEvent->seq = 0;
+  WRITE_BARRIER();
+  pEvent->bits = bits;
+  pEvent->interruptMask = interruptMask;
+  pEvent->risingMask = risingMask;
+  pEvent->outputs = outputs;
+  pEvent->sec = sec;
+  pEvent->nsec = nsec;
+  WRITE_BARRIER();
+  pEvent->seq = ++pShm->eventCount;
+}
+
+ipUnidigShm *ipUnidigShmAttach(const char *name)
+{
+  ipUnidigShm *pShm;
+  ipUnidigShmHeader header;
+  size_t size;
+  int fd;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return NULL;
+  if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+      (header.magic != IP_UNIDIG_SHM_MAGIC) ||
+      (header.version != IP_UNIDIG_SHM_VERSION) ||
+      (header.eventSize != sizeof(ipUnidigShmEvent))) {
+    close(fd);
+    return NULL;
+  }
+  size = segmentSize(header.ringSize);
+  pShm = mapSegment(fd, size, PROT_READ);
+  if (pShm) pShm->mask = header.ringSize - 1;
+  return pShm;
+}
+
+const ipUnidigShmHeader *ipUnidigShmGetHeader(ipUnidigShm *pShm)
+{
+  return pShm->pHeader;
+}
+
+int ipUnidigShmReadState(ipUnidigShm *pShm, ipUnidigShmState *pState)
+{
+  const ipUnidigShmState *pShared = pShm->pState;
+  uint32_t seq;
+  int retries = 0;
+
+  while (1) {
+    seq = pShared->seq;
+    READ_BARRIER();
+    memcpy(pState, (const void *)pShared, sizeof(*pState));
+    READ_BARRIER();
+    if (!(seq & 1) && (pShared->seq == seq)) break;
+    retries++;
+  }
+  return retries;
+}
+
+int ipUnidigShmReadEvent(ipUnidigShm *pShm, uint64_t *pNext, ipUnidigShmEvent *pEvent)
+{
+  const ipUnidigShmEvent *pShared;
+  uint64_t seq;
+
+  while (1) {
+    pShared = &pShm->pEvents[*pNext & pShm->mask];
+    seq = pShared->seq;
+    READ_BARRIER();
+    memcpy(pEvent, (const void *)pShared, sizeof(*pEvent));
+    READ_BARRIER();
+    /* Torn by the writer, try again */
+    if (pShared->seq != seq) continue;
+    if (seq == *pNext + 1) {
+      (*pNext)++;
+      return 1;
+    }
+    /* Not written yet, or being written */
+    if (seq <= *pNext) return 0;
+    /* Overwritten by an event one or more laps later.  Skip to half a ring
+     * behind it, which leaves the writer room before it catches up again. */
+    *pNext = seq - 1 - (pShm->mask + 1) / 2;
+  }
+}
+
+void ipUnidigShmClose(ipUnidigShm *pShm)
+{
+  if (!pShm) return;
+  munmap(pShm->base, pShm->size);
+  free(pShm);
+}
+
+#else /* __linux__ */
+
+ipUnidigShm *ipUnidigShmCreate(const char *name, const char *portName, uint32_t ringSize)
+{
+  (void)name; (void)portName; (void)ringSize;
+  fprintf(stderr, "ipUnidigShmCreate: shared memory is only supported on Linux\n");
+  return NULL;
+}
+
+void ipUnidigShmWriteState(ipUnidigShm *pShm, uint32_t inputs, uint32_t outputs,
+                           uint32_t sec, uint32_t nsec)
+{
+  (void)pShm; (void)inputs; (void)outputs; (void)sec; (void)nsec;
+}
+
+void ipUnidigShmWriteEvent(ipUnidigShm *pShm, uint32_t bits, uint32_t interruptMask,
+                           uint32_t risingMask, uint32_t outputs, uint32_t sec, uint32_t nsec)
+{
+  (void)pShm; (void)bits; (void)interruptMask; (void)risingMask; (void)outputs; (void)sec; (void)nsec;
+}
+
+ipUnidigShm *ipUnidigShmAttach(const char *name)
+{
+  (void)name;
+  return NULL;
+}
+
+const ipUnidigShmHeader *ipUnidigShmGetHeader(ipUnidigShm *pShm)
+{
+  (void)pShm;
+  return NULL;
+}
+
+int ipUnidigShmReadState(ipUnidigShm *pShm, ipUnidigShmState *pState)
+{
+  (void)pShm; (void)pState;
+  return 0;
+}
+
+int ipUnidigShmReadEvent(ipUnidigShm *pShm, uint64_t *pNext, ipUnidigShmEvent *pEvent)
+{
+  (void)pShm; (void)pNext; (void)pEvent;
+  return 0;
+}
+
+void ipUnidigShmClose(ipUnidigShm *pShm)
+{
+  (void)pShm;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,91 @@
+/* ipUnidigShm.h
+
+    Publication of the IP-Unidig inputs in POSIX shared memory.
+
+    The driver's poller thread writes the current input word and output
+    shadow, and a ring of input events, into a shared memory segment named
+    with ipUnidigShmEnable.  Readers in other processes on the same host map
+    the segment read-only and poll it with no system calls.
+
+    The segment is a header, one state line and the event ring.  Each
+    update writes a single cache line: the state is protected by a sequence
+    count that is odd while it is being written, and each event carries its
+    own sequence number, 0 while it is being written, so a reader can tell
+    when it has read a torn or overwritten copy.
+
+    This is only implemented on Linux.  On other systems ipUnidigShmCreate
+    and ipUnidigShmAttach return NULL.
+*/
+
+#ifndef IP_UNIDIG_SHM_H
+#define IP_UNIDIG_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IP_UNIDIG_SHM_MAGIC   0x49505544  /* "IPUD" */
+#define IP_UNIDIG_SHM_VERSION 1
+#define IP_UNIDIG_SHM_LINE    64
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ringSize;          /* Number of events, a power of 2 */
+  uint32_t eventSize;
+  char portName[48];
+} ipUnidigShmHeader;
+
+/* Times are POSIX seconds and nanoseconds */
+typedef struct {
+  volatile uint32_t seq;      /* Odd while the state is being written */
+  uint32_t inputs;
+  uint32_t outputs;
+  uint32_t sec;
+  uint32_t nsec;
+  uint32_t pad;
+  uint64_t eventCount;        /* Number of events written */
+  uint64_t updateCount;
+  uint8_t pad2[IP_UNIDIG_SHM_LINE - 40];
+} ipUnidigShmState;
+
+typedef struct {
+  volatile uint64_t seq;      /* Event number plus 1, 0 while being written */
+  uint32_t bits;
+  uint32_t interruptMask;     /* 0 for events seen by polling */
+  uint32_t risingMask;
+  uint32_t outputs;
+  uint32_t sec;
+  uint32_t nsec;
+} ipUnidigShmEvent;
+
+typedef struct ipUnidigShm ipUnidigShm;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Writer.  Creates the segment, or reuses one of the same name. */
+ipUnidigShm *ipUnidigShmCreate(const char *name, const char *portName, uint32_t ringSize);
+void ipUnidigShmWriteState(ipUnidigShm *pShm, uint32_t inputs, uint32_t outputs,
+                           uint32_t sec, uint32_t nsec);
+void ipUnidigShmWriteEvent(ipUnidigShm *pShm, uint32_t bits, uint32_t interruptMask,
+                           uint32_t risingMask, uint32_t outputs, uint32_t sec, uint32_t nsec);
+
+/* Reader */
+ipUnidigShm *ipUnidigShmAttach(const char *name);
+const ipUnidigShmHeader *ipUnidigShmGetHeader(ipUnidigShm *pShm);
+/* Copies a consistent state.  Returns the number of retries. */
+int ipUnidigShmReadState(ipUnidigShm *pShm, ipUnidigShmState *pState);
+/* Copies event *pNext and advances *pNext.  Returns 1 if an event was
+ * copied and 0 if there is no new event.  If the event has been
+ * overwritten *pNext skips to the oldest event in the ring, so the caller
+ * sees a gap in the event seq numbers. */
+int ipUnidigShmReadEvent(ipUnidigShm *pShm, uint64_t *pNext, ipUnidigShmEvent *pEvent);
+
+void ipUnidigShmClose(ipUnidigShm *pShm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IP_UNIDIG_SHM_H */
@@ -0,0 +1,93 @@
+/* ipUnidigShmTest.c
+
+    Reads the shared memory that an IP-Unidig port publishes with
+    ipUnidigShmEnable, and prints the input changes and events.  It also
+    checks that the event numbers have no gaps, and counts the state reads
+    that had to be retried because the driver was writing.
+
+    usage: ipUnidigShmTest [-t seconds] [-q] name
+      -t  Time to run.  Default 10 seconds.
+      -q  Only print the summary.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ipUnidigShm.h"
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.e9;
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: ipUnidigShmTest [-t seconds] [-q] name\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  ipUnidigShm *pShm;
+  const ipUnidigShmHeader *pHeader;
+  ipUnidigShmState state;
+  ipUnidigShmEvent event;
+  uint64_t next, expected, numEvents = 0, lost = 0, numReads = 0, retries = 0;
+  uint32_t lastInputs;
+  double duration = 10., end;
+  int quiet = 0, opt;
+
+  while ((opt = getopt(argc, argv, "t:q")) != -1) {
+    switch (opt) {
+      case 't': duration = atof(optarg); break;
+      case 'q': quiet = 1; break;
+      default: usage();
+    }
+  }
+  if (optind != argc - 1) usage();
+  pShm = ipUnidigShmAttach(argv[optind]);
+  if (!pShm) {
+    fprintf(stderr, "ipUnidigShmTest: cannot attach to %s\n", argv[optind]);
+    return 1;
+  }
+  pHeader = ipUnidigShmGetHeader(pShm);
+  printf("port %s, %u events of %u bytes\n", pHeader->portName, pHeader->ringSize, pHeader->eventSize);
+
+  /* Start with the events that are still in the ring */
+  ipUnidigShmReadState(pShm, &state);
+  lastInputs = state.inputs;
+  next = (state.eventCount > pHeader->ringSize) ? state.eventCount - pHeader->ringSize : 0;
+  expected = next + 1;
+  printf("inputs=%08x outputs=%08x events=%llu\n",
+         state.inputs, state.outputs, (unsigned long long)state.eventCount);
+  end = now() + duration;
+  while (now() < end) {
+    retries += ipUnidigShmReadState(pShm, &state);
+    numReads++;
+    if ((state.inputs != lastInputs) && !quiet) {
+      printf("%u.%09u inputs=%08x outputs=%08x\n", state.sec, state.nsec, state.inputs, state.outputs);
+    }
+    lastInputs = state.inputs;
+    while (ipUnidigShmReadEvent(pShm, &next, &event)) {
+      if (event.seq != expected) lost += event.seq - expected;
+      expected = event.seq + 1;
+      numEvents++;
+      if (!quiet) {
+        printf("%u.%09u event %llu bits=%08x interrupts=%08x rising=%08x\n",
+               event.sec, event.nsec, (unsigned long long)event.seq,
+               event.bits, event.interruptMask, event.risingMask);
+      }
+    }
+    usleep(1000);
+  }
+  printf("%llu events, %llu lost, %llu state reads, %llu retried\n",
+         (unsigned long long)numEvents, (unsigned long long)lost,
+         (unsigned long long)numReads, (unsigned long long)retries);
+  ipUnidigShmClose(pShm);
+  return (lost == 0) ? 0 : 2;
+}
@@ -0,0 +1,177 @@
+/* ipUnidigSoeTest.cpp
+
+    Regression test of the sequence-of-events history (SOE_*), on a
+    simulated card.
+
+    Edges injected on several bits, both spaced out and back to back, must
+    appear in the history in the order they happened, with the right bit,
+    direction and input word, and non-decreasing time stamps.  The history
+    must keep the newest SOE_SIZE events when it wraps, and SOE_RESET must
+    clear it.
+*/
+
+/* EPICS includes */
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include <asynDriver.h>
+#include <asynInt32SyncIO.h>
+#include <asynInt32ArraySyncIO.h>
+#include <asynFloat64ArraySyncIO.h>
+
+#include "ipUnidigHardware.h"
+
+#define TEST_PORT "SOE"
+#define TIMEOUT 1.0
+#define TEST_BITS 0xf
+/* Must match SOE_SIZE in drvIpUnidig.cpp */
+#define SOE_SIZE 1024
+
+typedef struct {
+  epicsFloat64 timeStamps[SOE_SIZE];
+  epicsInt32 bits[SOE_SIZE];
+  epicsInt32 directions[SOE_SIZE];
+  epicsInt32 inputs[SOE_SIZE];
+  size_t numEvents;
+} soeHistory;
+
+static soeHistory history;
+
+static epicsInt32 readInt32(const char *drvInfo)
+{
+  asynUser *pasynUser;
+  epicsInt32 value = -1;
+
+  pasynInt32SyncIO->connect(TEST_PORT, 0, &pasynUser, drvInfo);
+  pasynInt32SyncIO->read(pasynUser, &value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+  return value;
+}
+
+static void writeInt32(const char *drvInfo, epicsInt32 value)
+{
+  asynUser *pasynUser;
+
+  pasynInt32SyncIO->connect(TEST_PORT, 0, &pasynUser, drvInfo);
+  pasynInt32SyncIO->write(pasynUser, value, TIMEOUT);
+  pasynInt32SyncIO->disconnect(pasynUser);
+}
+
+static size_t readInt32Array(const char *drvInfo, epicsInt32 *values)
+{
+  asynUser *pasynUser;
+  size_t nIn = 0;
+
+  pasynInt32ArraySyncIO->connect(TEST_PORT, 0, &pasynUser, drvInfo);
+  pasynInt32ArraySyncIO->read(pasynUser, values, SOE_SIZE, &nIn, TIMEOUT);
+  pasynInt32ArraySyncIO->disconnect(pasynUser);
+  return nIn;
+}
+
+static void readHistory()
+{
+  asynUser *pasynUser;
+  size_t nIn = 0;
+
+  pasynFloat64ArraySyncIO->connect(TEST_PORT, 0, &pasynUser, "SOE_TIMESTAMP");
+  pasynFloat64ArraySyncIO->read(pasynUser, history.timeStamps, SOE_SIZE, &nIn, TIMEOUT);
+  pasynFloat64ArraySyncIO->disconnect(pasynUser);
+  history.numEvents = nIn;
+  readInt32Array("SOE_BIT", history.bits);
+  readInt32Array("SOE_DIRECTION", history.directions);
+  readInt32Array("SOE_INPUT", history.inputs);
+}
+
+static int timeStampsOrdered()
+{
+  size_t i;
+
+  for (i=1; i<history.numEvents; i++) {
+    if (history.timeStamps[i] < history.timeStamps[i-1]) return 0;
+  }
+  return 1;
+}
+
+MAIN(ipUnidigSoeTest)
+{
+  /* Bit, direction and resulting input word of each injected edge */
+  static const int sequence[][3] = {
+    {0, 1, 0x1}, {2, 1, 0x5}, {0, 0, 0x4}, {1, 1, 0x6}, {3, 1, 0xe}, {2, 0, 0xa}
+  };
+  int numSequence = sizeof(sequence) / sizeof(sequence[0]);
+  ipUnidigSimHardware *pSim;
+  epicsUInt32 inputs;
+  int i, ok;
+
+  testPlan(12);
+  /* Interrupts on both edges of the test bits */
+  initIpUnidigSim(TEST_PORT, 0, 100, 1, TEST_BITS, TEST_BITS);
+  pSim = ipUnidigSimHardware::find(TEST_PORT);
+  epicsThreadSleep(0.2);
+
+  /* Edges far enough apart to be in separate poller passes */
+  for (i=0; i<numSequence; i++) {
+    pSim->setInputs(sequence[i][2], TEST_BITS);
+    epicsThreadSleep(0.01);
+  }
+  epicsThreadSleep(0.2);
+  readHistory();
+  testOk(readInt32("SOE_NUM_EVENTS") == numSequence, "SOE_NUM_EVENTS=%d",
+         readInt32("SOE_NUM_EVENTS"));
+  testOk((int)history.numEvents == numSequence, "history has %d events", (int)history.numEvents);
+  for (i=0, ok=1; (i<numSequence) && (i<(int)history.numEvents); i++) {
+    if ((history.bits[i] != sequence[i][0]) || (history.directions[i] != sequence[i][1]) ||
+        (history.inputs[i] != sequence[i][2])) {
+      testDiag("event %d: bit=%d direction=%d input=%x", i,
+               history.bits[i], history.directions[i], history.inputs[i]);
+      ok = 0;
+    }
+  }
+  testOk(ok, "spaced edges in order with bit, direction and input");
+  testOk(timeStampsOrdered(), "time stamps non-decreasing");
+
+  /* The same edges back to back, so several are drained in one pass */
+  pSim->setInputs(0, TEST_BITS);
+  epicsThreadSleep(0.2);
+  writeInt32("SOE_RESET", 1);
+  epicsThreadSleep(0.2);
+  testOk(readInt32("SOE_NUM_EVENTS") == 0, "SOE_RESET clears the history");
+  for (i=0; i<numSequence; i++) pSim->setInputs(sequence[i][2], TEST_BITS);
+  epicsThreadSleep(0.2);
+  readHistory();
+  testOk((int)history.numEvents == numSequence, "burst history has %d events",
+         (int)history.numEvents);
+  for (i=0, ok=1; (i<numSequence) && (i<(int)history.numEvents); i++) {
+    if ((history.bits[i] != sequence[i][0]) || (history.directions[i] != sequence[i][1]) ||
+        (history.inputs[i] != sequence[i][2])) {
+      testDiag("event %d: bit=%d direction=%d input=%x", i,
+               history.bits[i], history.directions[i], history.inputs[i]);
+      ok = 0;
+    }
+  }
+  testOk(ok, "burst edges in order with bit, direction and input");
+  testOk(timeStampsOrdered(), "burst time stamps non-decreasing");
+
+  /* Wrap the history.  Bit 3 toggles, in chunks the ring can hold. */
+  inputs = sequence[numSequence-1][2];
+  for (i=0; i<SOE_SIZE + 100; i++) {
+    inputs ^= 0x8;
+    pSim->setInputs(inputs, TEST_BITS);
+    if ((i % 100) == 99) epicsThreadSleep(0.02);
+  }
+  epicsThreadSleep(0.2);
+  readHistory();
+  testOk(readInt32("SOE_NUM_EVENTS") == SOE_SIZE, "SOE_NUM_EVENTS stops at %d", SOE_SIZE);
+  testOk((int)history.numEvents == SOE_SIZE, "wrapped history has %d events",
+         (int)history.numEvents);
+  testOk((history.numEvents == SOE_SIZE) && (history.inputs[SOE_SIZE-1] == (epicsInt32)inputs),
+         "newest event is last");
+  for (i=1, ok=1; i<(int)history.numEvents; i++) {
+    if ((history.bits[i] != 3) || (history.directions[i] == history.directions[i-1])) ok = 0;
+  }
+  testOk(ok && timeStampsOrdered(), "wrapped history is the latest edges of bit 3, in order");
+
+  return testDone();
+}